@@ -0,0 +1,341 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#include <libavutil/frame.h>
+#include <libavutil/mem.h>
+#include <libavutil/samplefmt.h>
+
+#include "summary.h"
+#include "tap.h"
+#include "meter.h"
+#include "ring.h"
+#include "channels.h"
+#include "printf.h"
+
+// frames collected before the channel threads get to work
+#define CHAN_BATCH 16
+
+typedef struct {
+	chan_split    *cs;
+	unsigned       first;       // channels first, first + step, ...
+	unsigned       step;
+
+	ring          *work;        // batches to analyse
+	ring          *done;        // batches analysed
+
+	uint8_t       *buf;         // one channel of a packed frame
+	unsigned       buf_size;
+
+	pthread_t      thread;
+} chan_worker;
+
+struct chan_split {
+	unsigned       channels;
+	summary       *sum;
+
+	meter        **meters;      // one single-channel meter per channel
+	summary       *sums;        // raw blocks and peaks per channel
+	tap           *taps;
+
+	AVFrame       *batch[CHAN_BATCH];
+	unsigned       nb_batch;
+
+	chan_worker   *workers;
+	unsigned       nb_workers;
+};
+
+static void chan_split_run(chan_split *cs);
+static void *chan_split_worker(void *arg);
+static void chan_split_channel(chan_worker *w, AVFrame *frame, unsigned ch);
+
+int chan_split_supported(int sample_fmt) {
+	switch (sample_fmt) {
+		case AV_SAMPLE_FMT_S16:
+		case AV_SAMPLE_FMT_S16P:
+		case AV_SAMPLE_FMT_S32:
+		case AV_SAMPLE_FMT_S32P:
+		case AV_SAMPLE_FMT_FLT:
+		case AV_SAMPLE_FMT_FLTP:
+		case AV_SAMPLE_FMT_DBL:
+		case AV_SAMPLE_FMT_DBLP:
+			return 1;
+
+		default:
+			return 0;
+	}
+}
+
+chan_split *chan_split_new(unsigned channels, unsigned long samplerate,
+                           const char *engine, int flags, summary *sum,
+                           unsigned nb_threads) {
+	unsigned ch, i;
+	chan_split *cs;
+
+	cs = calloc(1, sizeof(chan_split));
+	if (cs == NULL)
+		fail_printf("OOM");
+
+	cs -> channels = channels;
+	cs -> sum      = sum;
+
+	cs -> meters = calloc(channels, sizeof(meter *));
+	cs -> sums   = calloc(channels, sizeof(summary));
+	cs -> taps   = calloc(channels, sizeof(tap));
+	if (cs -> meters == NULL || cs -> sums == NULL || cs -> taps == NULL)
+		fail_printf("OOM");
+
+	for (ch = 0; ch < channels; ch++) {
+		cs -> meters[ch] = meter_new(1, samplerate, engine, flags);
+		meter_set_channel(cs -> meters[ch], 0,
+		                  meter_default_channel(channels, ch));
+
+		summary_init(&cs -> sums[ch], 1, 0);
+		tap_init(&cs -> taps[ch], cs -> meters[ch], &cs -> sums[ch],
+		         0, 0, INT64_MAX);
+		cs -> taps[ch].raw = 1;
+	}
+
+	for (i = 0; i < CHAN_BATCH; i++) {
+		cs -> batch[i] = av_frame_alloc();
+		if (cs -> batch[i] == NULL)
+			fail_printf("OOM");
+	}
+
+	if (nb_threads < 1)
+		nb_threads = 1;
+
+	cs -> nb_workers = nb_threads < channels ? nb_threads : channels;
+
+	cs -> workers = calloc(cs -> nb_workers, sizeof(chan_worker));
+	if (cs -> workers == NULL)
+		fail_printf("OOM");
+
+	for (i = 0; i < cs -> nb_workers; i++) {
+		chan_worker *w = &cs -> workers[i];
+
+		w -> cs    = cs;
+		w -> first = i;
+		w -> step  = cs -> nb_workers;
+		w -> work  = ring_new(2);
+		w -> done  = ring_new(2);
+
+		if (pthread_create(&w -> thread, NULL, chan_split_worker, w) != 0)
+			fail_printf("Could not create channel thread");
+	}
+
+	return cs;
+}
+
+const char *chan_split_engine(const chan_split *cs) {
+	return meter_engine(cs -> meters[0]);
+}
+
+void chan_split_add(chan_split *cs, AVFrame *frame) {
+	if ((unsigned) frame -> channels != cs -> channels ||
+	    !chan_split_supported(frame -> format))
+		fail_printf("Stream format changed while scanning");
+
+	if (av_frame_ref(cs -> batch[cs -> nb_batch], frame) < 0)
+		fail_printf("OOM");
+
+	if (++cs -> nb_batch == CHAN_BATCH)
+		chan_split_run(cs);
+}
+
+/*
+ * Analyses what is left, adds the channel peaks to the stream summary and
+ * frees everything. Returns the number of threads that were used, and adds
+ * the true-peak statistics of the channels (see meter_stats()).
+ */
+unsigned chan_split_free(chan_split *cs, unsigned long *peak_parts,
+                         unsigned long *peak_oversampled) {
+	unsigned ch, i, nb_workers = cs -> nb_workers;
+	unsigned long parts, oversampled;
+
+	chan_split_run(cs);
+
+	for (i = 0; i < cs -> nb_workers; i++) {
+		chan_worker *w = &cs -> workers[i];
+
+		ring_push(w -> work, NULL);
+		pthread_join(w -> thread, NULL);
+
+		ring_free(w -> work);
+		ring_free(w -> done);
+		av_free(w -> buf);
+	}
+
+	for (ch = 0; ch < cs -> channels; ch++) {
+		summary_add_peak(cs -> sum, ch, cs -> sums[ch].sample_peak[0],
+		                 cs -> sums[ch].true_peak[0]);
+
+		meter_stats(cs -> meters[ch], &parts, &oversampled);
+		*peak_parts       += parts;
+		*peak_oversampled += oversampled;
+
+		summary_free(&cs -> sums[ch]);
+		meter_free(cs -> meters[ch]);
+	}
+
+	for (i = 0; i < CHAN_BATCH; i++)
+		av_frame_free(&cs -> batch[i]);
+
+	free(cs -> workers);
+	free(cs -> taps);
+	free(cs -> sums);
+	free(cs -> meters);
+	free(cs);
+
+	return nb_workers;
+}
+
+/*
+ * Hand the collected frames to all channel threads, wait for them, and
+ * add up the channel energies of every block that was completed.
+ */
+static void chan_split_run(chan_split *cs) {
+	unsigned ch, i;
+	size_t b;
+
+	if (cs -> nb_batch == 0)
+		return;
+
+	for (i = 0; i < cs -> nb_workers; i++)
+		ring_push(cs -> workers[i].work, cs);
+
+	for (i = 0; i < cs -> nb_workers; i++)
+		ring_pop(cs -> workers[i].done);
+
+	// every channel completed the same blocks
+	for (b = 0; b < cs -> sums[0].gating.size; b++) {
+		double energy = 0.0;
+
+		for (ch = 0; ch < cs -> channels; ch++)
+			energy += cs -> sums[ch].gating.energies[b];
+
+		summary_add_gating(cs -> sum, energy);
+	}
+
+	for (b = 0; b < cs -> sums[0].shortterm.size; b++) {
+		double energy = 0.0;
+
+		for (ch = 0; ch < cs -> channels; ch++)
+			energy += cs -> sums[ch].shortterm.energies[b];
+
+		summary_add_shortterm(cs -> sum, energy);
+	}
+
+	for (ch = 0; ch < cs -> channels; ch++) {
+		cs -> sums[ch].gating.size    = 0;
+		cs -> sums[ch].shortterm.size = 0;
+	}
+
+	for (i = 0; i < cs -> nb_batch; i++)
+		av_frame_unref(cs -> batch[i]);
+
+	cs -> nb_batch = 0;
+}
+
+static void *chan_split_worker(void *arg) {
+	chan_worker *w = arg;
+	chan_split *cs;
+	unsigned ch, i;
+
+	while ((cs = ring_pop(w -> work)) != NULL) {
+		for (ch = w -> first; ch < cs -> channels; ch += w -> step)
+			for (i = 0; i < cs -> nb_batch; i++)
+				chan_split_channel(w, cs -> batch[i], ch);
+
+		ring_push(w -> done, cs);
+	}
+
+	return NULL;
+}
+
+// copy one channel out of a packed frame
+#define CHAN_GATHER(TYPE)                                                     \
+	do {                                                                        \
+		const TYPE *in = (const TYPE *) frame -> data[0] + ch;                    \
+		TYPE *out = (TYPE *) w -> buf;                                            \
+		int i;                                                                    \
+                                                                              \
+		for (i = 0; i < frame -> nb_samples; i++)                                 \
+			out[i] = in[i * frame -> channels];                                     \
+	} while (0)
+
+static void chan_split_channel(chan_worker *w, AVFrame *frame, unsigned ch) {
+	int size = av_get_bytes_per_sample(frame -> format);
+	tap_pcm pcm;
+
+	switch (frame -> format) {
+		case AV_SAMPLE_FMT_S16:
+		case AV_SAMPLE_FMT_S16P:
+			pcm.type = TAP_S16;
+			break;
+
+		case AV_SAMPLE_FMT_S32:
+		case AV_SAMPLE_FMT_S32P:
+			pcm.type = TAP_S32;
+			break;
+
+		case AV_SAMPLE_FMT_DBL:
+		case AV_SAMPLE_FMT_DBLP:
+			pcm.type = TAP_DBL;
+			break;
+
+		default:
+			pcm.type = TAP_FLT;
+			break;
+	}
+
+	pcm.stride = size;
+
+	if (av_sample_fmt_is_planar(frame -> format)) {
+		pcm.data = frame -> extended_data[ch];
+	} else {
+		av_fast_malloc(&w -> buf, &w -> buf_size, size * frame -> nb_samples);
+		if (w -> buf == NULL)
+			fail_printf("OOM");
+
+		switch (size) {
+			case 2:  CHAN_GATHER(uint16_t); break;
+			case 4:  CHAN_GATHER(uint32_t); break;
+			default: CHAN_GATHER(uint64_t); break;
+		}
+
+		pcm.data = w -> buf;
+	}
+
+	tap_add(&w -> cs -> taps[ch], &pcm, 0, frame -> nb_samples);
+}
@@ -0,0 +1,635 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif
+
+#include <libavformat/avio.h>
+#include <libavutil/avutil.h>
+#include <libavutil/common.h>
+
+#include "input.h"
+#include "printf.h"
+
+// reads in flight per file with io_uring
+#define INPUT_URING_DEPTH 8
+
+// with INPUT_NOCACHE, pages read are given back in steps of this size
+#define INPUT_DROP_STEP   (8 * 1024 * 1024)
+
+#ifdef HAVE_LIBURING
+/* A block of read-ahead, block number n covers [base + n * size, ...). */
+typedef struct {
+	uint8_t       *buf;
+	int64_t        n;
+	int            pending;     // submitted, not completed yet
+	int            res;         // bytes read, or -errno
+} input_block;
+
+/*
+ * An io_uring and its block buffers, set up once per thread and kept for
+ * the next files (like the decoders a scanning thread keeps). An input
+ * that finds the ring of its thread in use sets up one of its own.
+ */
+typedef struct {
+	struct io_uring ring;
+	int             ok;         // set up; 0: the kernel did not allow it
+	int             busy;       // an input reads through it
+	uint8_t        *bufs[INPUT_URING_DEPTH];
+	size_t          block_size; // of bufs
+} input_uring;
+#endif
+
+struct input {
+	int            fd;
+	int            mode;        // INPUT_*, as asked for
+	int64_t        size;
+	int64_t        pos;         // where the demuxer reads next
+	const uint8_t *map;         // the whole file, or NULL
+
+	/* With INPUT_NOCACHE, pages are given back to the page cache once
+	 * read, up to dropped; pages that were cached before are kept. */
+	long           page;
+	unsigned char *resident;    // per page: cached before, NULL: unknown
+	int64_t        dropped;
+
+#ifdef HAVE_LIBURING
+	/* With io_uring, blocks [head, tail) are read ahead of the demuxer;
+	 * the window starts over wherever it seeks to. */
+	input_uring   *uring;       // NULL: not used
+	int            own_uring;   // not the thread's, freed with the input
+	input_block    blocks[INPUT_URING_DEPTH];
+	size_t         block_size;
+	int64_t        base;
+	int64_t        head;
+	int64_t        tail;
+#endif
+
+	AVIOContext   *avio;
+	input_stats    stats;
+};
+
+static int input_read(void *opaque, uint8_t *buf, int buf_size);
+static int64_t input_seek(void *opaque, int64_t offset, int whence);
+
+static void input_cached(input *in);
+static void input_drop(input *in, int64_t from, int64_t to);
+
+#ifdef HAVE_LIBURING
+static int input_uring_init(input *in, size_t block_size);
+static void input_uring_free(input *in);
+static int input_uring_read(input *in, uint8_t *buf, int buf_size);
+#endif
+
+input *input_open(const char *file, int mode, size_t read_size, int flags) {
+	struct stat st;
+	uint8_t *buf;
+	input *in;
+	int fd;
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+		close(fd);
+		return NULL;
+	}
+
+	in = calloc(1, sizeof(input));
+	if (in == NULL)
+		fail_printf("OOM");
+
+	in -> fd          = fd;
+	in -> mode        = mode;
+	in -> size        = st.st_size;
+	in -> page        = sysconf(_SC_PAGESIZE);
+	in -> stats.calls = 2;
+
+	if (flags & INPUT_NOCACHE) {
+		input_cached(in);
+
+		posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		in -> stats.calls++;
+	}
+
+	// reading is the fallback
+	if (mode == INPUT_MMAP)
+		input_map(in);
+
+	if (read_size == 0)
+		read_size = INPUT_READ_SIZE;
+
+#ifdef HAVE_LIBURING
+	// plain reads if the kernel does not allow it
+	if (mode == INPUT_URING && in -> size > 0)
+		input_uring_init(in, read_size);
+#endif
+
+	buf = av_malloc(read_size);
+	if (buf == NULL)
+		fail_printf("OOM");
+
+	in -> avio = avio_alloc_context(buf, read_size, 0, in,
+	                                input_read, NULL, input_seek);
+	if (in -> avio == NULL)
+		fail_printf("OOM");
+
+	return in;
+}
+
+void input_close(input *in) {
+	if (in == NULL)
+		return;
+
+#ifdef HAVE_LIBURING
+	input_uring_free(in);
+#endif
+
+	if (in -> map != NULL)
+		munmap((void *) in -> map, in -> size);
+	in -> map = NULL;
+
+	// all of it, pages read again after a seek back included
+	input_drop(in, 0, in -> size);
+	free(in -> resident);
+
+	close(in -> fd);
+
+	av_freep(&in -> avio -> buffer);
+	avio_context_free(&in -> avio);
+
+	free(in);
+}
+
+AVIOContext *input_avio(input *in) {
+	return in -> avio;
+}
+
+int64_t input_size(input *in) {
+	return in -> size;
+}
+
+/* The whole file, mapped on first use; NULL if it cannot be mapped. */
+const uint8_t *input_map(input *in) {
+	void *map;
+
+	if (in -> map != NULL || in -> size == 0)
+		return in -> map;
+
+	map = mmap(NULL, in -> size, PROT_READ, MAP_PRIVATE, in -> fd, 0);
+	in -> stats.calls++;
+
+	if (map == MAP_FAILED)
+		return NULL;
+
+	madvise(map, in -> size, MADV_SEQUENTIAL);
+	in -> stats.calls++;
+
+	in -> map = map;
+	return in -> map;
+}
+
+/* Up to size bytes at pos, without moving the demuxer's position; fewer
+ * only at the end of the file. Returns the bytes read, or -1. */
+int64_t input_pread(input *in, int64_t pos, uint8_t *buf, size_t size) {
+	size_t done = 0;
+
+	while (done < size) {
+		ssize_t n = pread(in -> fd, buf + done, size - done, pos + done);
+		in -> stats.calls++;
+		in -> stats.reads++;
+
+		if (n < 0 && errno == EINTR)
+			continue;
+
+		if (n < 0)
+			return -1;
+
+		// shrunk while reading
+		if (n == 0)
+			break;
+
+		done += n;
+	}
+
+	in -> stats.bytes += done;
+
+	return done;
+}
+
+/* The file has been read up to end by a reader of input_map() or
+ * input_pread(). */
+void input_seen(input *in, int64_t end) {
+	if (end - in -> dropped >= INPUT_DROP_STEP) {
+		input_drop(in, in -> dropped, end);
+		in -> dropped = end;
+	}
+}
+
+const char *input_mode(input *in) {
+#ifdef HAVE_LIBURING
+	if (in -> uring != NULL)
+		return "uring";
+#endif
+
+	return (in -> mode == INPUT_MMAP && in -> map != NULL) ? "mmap" : "read";
+}
+
+void input_get_stats(input *in, input_stats *stats) {
+	*stats = in -> stats;
+}
+
+/* Positioned reads: a seek costs no system call. */
+static int input_read(void *opaque, uint8_t *buf, int buf_size) {
+	input *in = opaque;
+	ssize_t n;
+
+	if (in -> pos >= in -> size)
+		return AVERROR_EOF;
+
+	n = 0;
+
+#ifdef HAVE_LIBURING
+	// anything it cannot serve (a short or failed read) is read directly
+	if (in -> uring != NULL)
+		n = input_uring_read(in, buf, buf_size);
+#endif
+
+	if (in -> map != NULL) {
+		n = FFMIN(buf_size, in -> size - in -> pos);
+		memcpy(buf, in -> map + in -> pos, n);
+	} else if (n <= 0) {
+		do {
+			n = pread(in -> fd, buf, buf_size, in -> pos);
+			in -> stats.calls++;
+			in -> stats.reads++;
+		} while (n < 0 && errno == EINTR);
+
+		if (n < 0)
+			return AVERROR(errno);
+
+		// shrunk while reading
+		if (n == 0)
+			return AVERROR_EOF;
+	}
+
+	in -> pos         += n;
+	in -> stats.bytes += n;
+
+	input_seen(in, in -> pos);
+
+	return n;
+}
+
+static int64_t input_seek(void *opaque, int64_t offset, int whence) {
+	input *in = opaque;
+	int64_t pos;
+
+	switch (whence & ~AVSEEK_FORCE) {
+		case AVSEEK_SIZE:
+			return in -> size;
+
+		case SEEK_SET:
+			pos = offset;
+			break;
+
+		case SEEK_CUR:
+			pos = in -> pos + offset;
+			break;
+
+		case SEEK_END:
+			pos = in -> size + offset;
+			break;
+
+		default:
+			return AVERROR(EINVAL);
+	}
+
+	if (pos < 0)
+		return AVERROR(EINVAL);
+
+	in -> pos = pos;
+
+	// pages read again behind this are only given back on close
+	if (pos < in -> dropped)
+		in -> dropped = pos;
+
+	return pos;
+}
+
+/* Notes which pages of the file are in the page cache before it is read
+ * (mincore() needs a mapping). Without that, nothing is given back. */
+static void input_cached(input *in) {
+	int64_t nb_pages = (in -> size + in -> page - 1) / in -> page;
+	void *map;
+
+	if (in -> size == 0)
+		return;
+
+	map = mmap(NULL, in -> size, PROT_READ, MAP_PRIVATE, in -> fd, 0);
+	in -> stats.calls++;
+
+	if (map == MAP_FAILED)
+		return;
+
+	in -> resident = malloc(nb_pages);
+	if (in -> resident == NULL)
+		fail_printf("OOM");
+
+	if (mincore(map, in -> size, in -> resident) < 0) {
+		free(in -> resident);
+		in -> resident = NULL;
+	}
+
+	munmap(map, in -> size);
+	in -> stats.calls += 2;
+}
+
+/* Give back [from, to) to the page cache, but for the pages that were
+ * cached before: someone else is using those. */
+static void input_drop(input *in, int64_t from, int64_t to) {
+	int64_t page = in -> page, p, q, end;
+
+	if (in -> resident == NULL)
+		return;
+
+	// whole pages only, the last one once the file is read to the end
+	end = (to >= in -> size) ? (in -> size + page - 1) / page : to / page;
+
+	for (p = from / page; p < end; p = q) {
+		if (in -> resident[p] & 1) {
+			q = p + 1;
+			continue;
+		}
+
+		for (q = p + 1; q < end && !(in -> resident[q] & 1); q++);
+
+		// mapped pages stay in the page cache
+		if (in -> map != NULL) {
+			madvise((void *) (in -> map + p * page), (q - p) * page, MADV_DONTNEED);
+			in -> stats.calls++;
+		}
+
+		posix_fadvise(in -> fd, p * page, (q - p) * page, POSIX_FADV_DONTNEED);
+		in -> stats.calls++;
+	}
+}
+
+#ifdef HAVE_LIBURING
+static pthread_key_t  input_uring_key;
+static pthread_once_t input_uring_once = PTHREAD_ONCE_INIT;
+
+static void input_uring_destroy(void *arg) {
+	input_uring *ur = arg;
+	int i;
+
+	if (ur -> ok)
+		io_uring_queue_exit(&ur -> ring);
+
+	for (i = 0; i < INPUT_URING_DEPTH; i++)
+		av_free(ur -> bufs[i]);
+
+	free(ur);
+}
+
+static void input_uring_key_init(void) {
+	if (pthread_key_create(&input_uring_key, input_uring_destroy) != 0)
+		fail_printf("Could not create thread key");
+}
+
+static input_uring *input_uring_new(input *in) {
+	input_uring *ur;
+
+	ur = calloc(1, sizeof(input_uring));
+	if (ur == NULL)
+		fail_printf("OOM");
+
+	in -> stats.calls++;
+	ur -> ok = io_uring_queue_init(INPUT_URING_DEPTH, &ur -> ring, 0) == 0;
+
+	return ur;
+}
+
+static int input_uring_init(input *in, size_t block_size) {
+	input_uring *ur;
+	int i;
+
+	pthread_once(&input_uring_once, input_uring_key_init);
+
+	ur = pthread_getspecific(input_uring_key);
+	if (ur == NULL) {
+		ur = input_uring_new(in);
+
+		if (pthread_setspecific(input_uring_key, ur) != 0)
+			fail_printf("Could not set thread ring");
+	} else if (ur -> busy) {
+		ur = input_uring_new(in);
+		in -> own_uring = 1;
+	}
+
+	if (!ur -> ok) {
+		if (in -> own_uring)
+			input_uring_destroy(ur);
+
+		in -> own_uring = 0;
+		return -1;
+	}
+
+	// a larger read size than the last file's needs larger buffers
+	if (ur -> block_size < block_size) {
+		for (i = 0; i < INPUT_URING_DEPTH; i++) {
+			av_free(ur -> bufs[i]);
+
+			ur -> bufs[i] = av_malloc(block_size);
+			if (ur -> bufs[i] == NULL)
+				fail_printf("OOM");
+		}
+
+		ur -> block_size = block_size;
+	}
+
+	for (i = 0; i < INPUT_URING_DEPTH; i++)
+		in -> blocks[i].buf = ur -> bufs[i];
+
+	ur -> busy       = 1;
+	in -> uring      = ur;
+	in -> block_size = block_size;
+
+	return 0;
+}
+
+/* Reap completions until block b is read. */
+static int input_uring_wait(input *in, input_block *b) {
+	struct io_uring_cqe *cqe;
+	input_block *done;
+	int rc;
+
+	while (b -> pending) {
+		rc = io_uring_peek_cqe(&in -> uring -> ring, &cqe);
+
+		if (rc == -EAGAIN) {
+			rc = io_uring_wait_cqe(&in -> uring -> ring, &cqe);
+			in -> stats.calls++;
+		}
+
+		if (rc == -EINTR)
+			continue;
+
+		if (rc < 0)
+			return rc;
+
+		done = io_uring_cqe_get_data(cqe);
+		done -> res     = cqe -> res;
+		done -> pending = 0;
+
+		io_uring_cqe_seen(&in -> uring -> ring, cqe);
+	}
+
+	return 0;
+}
+
+/* Wait for every read in flight; their buffers are then free. */
+static int input_uring_drain(input *in) {
+	int i, rc = 0;
+
+	for (i = 0; i < INPUT_URING_DEPTH && rc == 0; i++)
+		rc = input_uring_wait(in, &in -> blocks[i]);
+
+	return rc;
+}
+
+/* Submit reads up to INPUT_URING_DEPTH blocks ahead, or the end. */
+static void input_uring_fill(input *in) {
+	int64_t bs = in -> block_size;
+	int queued = 0;
+
+	while (in -> tail - in -> head < INPUT_URING_DEPTH &&
+	       in -> base + in -> tail * bs < in -> size) {
+		input_block *b = &in -> blocks[in -> tail % INPUT_URING_DEPTH];
+		struct io_uring_sqe *sqe = io_uring_get_sqe(&in -> uring -> ring);
+
+		if (sqe == NULL)
+			break;
+
+		io_uring_prep_read(sqe, in -> fd, b -> buf, bs, in -> base + in -> tail * bs);
+		io_uring_sqe_set_data(sqe, b);
+
+		b -> n       = in -> tail++;
+		b -> pending = 1;
+
+		queued++;
+	}
+
+	if (queued > 0) {
+		io_uring_submit(&in -> uring -> ring);
+		in -> stats.calls++;
+		in -> stats.reads += queued;
+	}
+}
+
+/*
+ * Serve a read from the read-ahead window. Returns the bytes copied, or 0
+ * (or less) if the caller must read directly: after a failed or short
+ * read, and at the end of the file.
+ */
+static int input_uring_read(input *in, uint8_t *buf, int buf_size) {
+	int64_t bs = in -> block_size, n, off;
+	input_block *b;
+
+	// a seek out of the window: start a new one there
+	if (in -> pos <  in -> base + in -> head * bs ||
+	    in -> pos >= in -> base + in -> tail * bs) {
+		if (input_uring_drain(in) < 0)
+			return -1;
+
+		in -> base = in -> pos;
+		in -> head = in -> tail = 0;
+	}
+
+	n = (in -> pos - in -> base) / bs;
+
+	// the blocks before are done with, their buffers get the next ones
+	while (in -> head < n) {
+		if (input_uring_wait(in, &in -> blocks[in -> head % INPUT_URING_DEPTH]) < 0)
+			return -1;
+
+		in -> head++;
+	}
+
+	input_uring_fill(in);
+
+	b = &in -> blocks[n % INPUT_URING_DEPTH];
+	if (b -> n != n || input_uring_wait(in, b) < 0 || b -> res < 0)
+		return -1;
+
+	off = in -> pos - (in -> base + n * bs);
+	n   = FFMIN(buf_size, b -> res - off);
+
+	if (n > 0)
+		memcpy(buf, b -> buf + off, n);
+
+	return n;
+}
+
+/* Gives the ring back to its thread, with nothing in flight. */
+static void input_uring_free(input *in) {
+	if (in -> uring == NULL)
+		return;
+
+	// the kernel must be done with the buffers before they are reused
+	if (input_uring_drain(in) < 0) {
+		// completions are lost: not fit for the next file
+		if (!in -> own_uring)
+			pthread_setspecific(input_uring_key, NULL);
+
+		in -> own_uring = 1;
+	}
+
+	if (in -> own_uring)
+		input_uring_destroy(in -> uring);
+	else
+		in -> uring -> busy = 0;
+
+	in -> uring = NULL;
+}
+#endif
@@ -0,0 +1,77 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// how input_open() reads a file
+enum { INPUT_READ, INPUT_MMAP, INPUT_URING };
+
+// input_open() flags: leave the page cache as it was before the file was
+// read (pages cached before stay, the others are given back once read)
+#define INPUT_NOCACHE 1
+
+// bytes per read() by default
+#define INPUT_READ_SIZE (1024 * 1024)
+
+typedef struct {
+	unsigned long      calls;   // system calls made for the file
+	unsigned long      reads;   // of which read()s
+	unsigned long long bytes;   // bytes handed to the demuxer
+} input_stats;
+
+/* A local file, read for the demuxer through an AVIOContext of its own:
+ * in large sequential read()s of a configurable size, straight from a
+ * mapping of the whole file, or with reads of the next few blocks kept in
+ * flight through io_uring (if built with liburing and allowed by the
+ * kernel, plain reads otherwise), instead of libavformat's 32 KB reads.
+ * The io_uring is set up once per thread and kept for its next files.
+ * Only regular files are opened; anything else is left to libavformat. */
+typedef struct input input;
+
+input *input_open(const char *file, int mode, size_t read_size, int flags);
+void input_close(input *in);
+
+struct AVIOContext *input_avio(input *in);
+int64_t input_size(input *in);
+const char *input_mode(input *in);
+
+/* Reading without the demuxer: the file mapped (NULL if it cannot be) or
+ * read at a given position, and how far it has been read, for
+ * INPUT_NOCACHE. */
+const uint8_t *input_map(input *in);
+int64_t input_pread(input *in, int64_t pos, uint8_t *buf, size_t size);
+void input_seen(input *in, int64_t end);
+void input_get_stats(input *in, input_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
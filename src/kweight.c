@@ -0,0 +1,263 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define KWEIGHT_X86 1
+#include <immintrin.h>
+#endif
+
+#include "kweight.h"
+
+static void kweight_scalar(const kweight_coeffs *k, double *v,
+                           const double *x, size_t lanes, size_t nb,
+                           double *sum, double *peak);
+
+/* Same coefficients as libebur128 (ebur128_init_filter). */
+void kweight_init(kweight_coeffs *k, unsigned long samplerate) {
+	double f0 = 1681.974450955533;
+	double G  =    3.999843853973347;
+	double Q  =    0.7071752369554196;
+
+	double K  = tan(M_PI * f0 / (double) samplerate);
+	double Vh = pow(10.0, G / 20.0);
+	double Vb = pow(Vh, 0.4996667741545416);
+
+	double pb[3] = { 0.0,  0.0, 0.0 };
+	double pa[3] = { 1.0,  0.0, 0.0 };
+	double rb[3] = { 1.0, -2.0, 1.0 };
+	double ra[3] = { 1.0,  0.0, 0.0 };
+
+	double a0 = 1.0 + K / Q + K * K;
+
+	pb[0] = (Vh + Vb * K / Q + K * K) / a0;
+	pb[1] = 2.0 * (K * K - Vh) / a0;
+	pb[2] = (Vh - Vb * K / Q + K * K) / a0;
+	pa[1] = 2.0 * (K * K - 1.0) / a0;
+	pa[2] = (1.0 - K / Q + K * K) / a0;
+
+	f0 = 38.13547087602444;
+	Q  =  0.5003270373238773;
+	K  = tan(M_PI * f0 / (double) samplerate);
+
+	ra[1] = 2.0 * (K * K - 1.0) / (1.0 + K / Q + K * K);
+	ra[2] = (1.0 - K / Q + K * K) / (1.0 + K / Q + K * K);
+
+	k -> b[0] = pb[0] * rb[0];
+	k -> b[1] = pb[0] * rb[1] + pb[1] * rb[0];
+	k -> b[2] = pb[0] * rb[2] + pb[1] * rb[1] + pb[2] * rb[0];
+	k -> b[3] = pb[1] * rb[2] + pb[2] * rb[1];
+	k -> b[4] = pb[2] * rb[2];
+
+	k -> a[0] = pa[0] * ra[0];
+	k -> a[1] = pa[0] * ra[1] + pa[1] * ra[0];
+	k -> a[2] = pa[0] * ra[2] + pa[1] * ra[1] + pa[2] * ra[0];
+	k -> a[3] = pa[1] * ra[2] + pa[2] * ra[1];
+	k -> a[4] = pa[2] * ra[2];
+}
+
+/*
+ * Reference kernel. The feedback term of the previous output is subtracted
+ * last, so only one multiply and one subtract are on the critical path from
+ * one frame to the next. Like the vector kernels it must not be contracted
+ * to FMA (the file is also built with -ffp-contract=off).
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+__attribute__((optimize("fp-contract=off")))
+#endif
+static void kweight_scalar(const kweight_coeffs *k, double *v,
+                           const double *x, size_t lanes, size_t nb,
+                           double *sum, double *peak) {
+	size_t c, i;
+
+	for (c = 0; c < lanes; c++) {
+		double v1 = v[1 * lanes + c], v2 = v[2 * lanes + c];
+		double v3 = v[3 * lanes + c], v4 = v[4 * lanes + c];
+		double s = sum[c], p = peak[c];
+		const double *in = x + c;
+
+		for (i = 0; i < nb; i++, in += lanes) {
+			double v0, y;
+
+			v0 = *in - k -> a[4] * v4 - k -> a[3] * v3 - k -> a[2] * v2;
+			v0 = v0 - k -> a[1] * v1;
+
+			y = k -> b[0] * v0 + k -> b[1] * v1 + k -> b[2] * v2 +
+			    k -> b[3] * v3 + k -> b[4] * v4;
+
+			s += y * y;
+			p  = fmax(p, fabs(*in));
+
+			v4 = v3;
+			v3 = v2;
+			v2 = v1;
+			v1 = v0;
+		}
+
+		v[1 * lanes + c] = v1;
+		v[2 * lanes + c] = v2;
+		v[3 * lanes + c] = v3;
+		v[4 * lanes + c] = v4;
+		sum[c]  = s;
+		peak[c] = p;
+	}
+}
+
+#ifdef KWEIGHT_X86
+
+/*
+ * The vector kernels are the scalar one with one channel per lane. Multiply
+ * and add are kept apart (no FMA contraction), so they give the same bits
+ * as the scalar kernel.
+ */
+#define KWEIGHT_KERNEL(NAME, TARGET, W, VEC, PFX, ABS)                          \
+__attribute__((target(TARGET), optimize("fp-contract=off")))                \
+static void NAME(const kweight_coeffs *k, double *v,                          \
+                 const double *x, size_t lanes, size_t nb,                    \
+                 double *sum, double *peak) {                                 \
+	const VEC b0 = PFX##_set1_pd(k -> b[0]), b1 = PFX##_set1_pd(k -> b[1]);     \
+	const VEC b2 = PFX##_set1_pd(k -> b[2]), b3 = PFX##_set1_pd(k -> b[3]);     \
+	const VEC b4 = PFX##_set1_pd(k -> b[4]);                                    \
+	const VEC a1 = PFX##_set1_pd(k -> a[1]), a2 = PFX##_set1_pd(k -> a[2]);     \
+	const VEC a3 = PFX##_set1_pd(k -> a[3]), a4 = PFX##_set1_pd(k -> a[4]);     \
+	size_t c, i;                                                                \
+                                                                              \
+	for (c = 0; c < lanes; c += W) {                                            \
+		VEC v1 = PFX##_loadu_pd(v + 1 * lanes + c);                               \
+		VEC v2 = PFX##_loadu_pd(v + 2 * lanes + c);                               \
+		VEC v3 = PFX##_loadu_pd(v + 3 * lanes + c);                               \
+		VEC v4 = PFX##_loadu_pd(v + 4 * lanes + c);                               \
+		VEC s  = PFX##_loadu_pd(sum + c);                                         \
+		VEC p  = PFX##_loadu_pd(peak + c);                                        \
+		const double *in = x + c;                                                 \
+                                                                              \
+		for (i = 0; i < nb; i++, in += lanes) {                                   \
+			VEC xi = PFX##_loadu_pd(in), v0, y;                                     \
+                                                                              \
+			v0 = PFX##_sub_pd(xi, PFX##_mul_pd(a4, v4));                            \
+			v0 = PFX##_sub_pd(v0, PFX##_mul_pd(a3, v3));                            \
+			v0 = PFX##_sub_pd(v0, PFX##_mul_pd(a2, v2));                            \
+			v0 = PFX##_sub_pd(v0, PFX##_mul_pd(a1, v1));                            \
+                                                                              \
+			y = PFX##_mul_pd(b0, v0);                                               \
+			y = PFX##_add_pd(y, PFX##_mul_pd(b1, v1));                              \
+			y = PFX##_add_pd(y, PFX##_mul_pd(b2, v2));                              \
+			y = PFX##_add_pd(y, PFX##_mul_pd(b3, v3));                              \
+			y = PFX##_add_pd(y, PFX##_mul_pd(b4, v4));                              \
+                                                                              \
+			s = PFX##_add_pd(s, PFX##_mul_pd(y, y));                                \
+			p = PFX##_max_pd(p, ABS(xi));                                           \
+                                                                              \
+			v4 = v3;                                                                \
+			v3 = v2;                                                                \
+			v2 = v1;                                                                \
+			v1 = v0;                                                                \
+		}                                                                         \
+                                                                              \
+		PFX##_storeu_pd(v + 1 * lanes + c, v1);                                   \
+		PFX##_storeu_pd(v + 2 * lanes + c, v2);                                   \
+		PFX##_storeu_pd(v + 3 * lanes + c, v3);                                   \
+		PFX##_storeu_pd(v + 4 * lanes + c, v4);                                   \
+		PFX##_storeu_pd(sum + c, s);                                              \
+		PFX##_storeu_pd(peak + c, p);                                             \
+	}                                                                           \
+}
+
+#define KWEIGHT_ABS128(X) _mm_andnot_pd(_mm_set1_pd(-0.0), X)
+#define KWEIGHT_ABS256(X) _mm256_andnot_pd(_mm256_set1_pd(-0.0), X)
+#define KWEIGHT_ABS512(X) _mm512_abs_pd(X)
+
+KWEIGHT_KERNEL(kweight_sse2,   "sse2",    2, __m128d, _mm,    KWEIGHT_ABS128)
+KWEIGHT_KERNEL(kweight_avx2,   "avx2",    4, __m256d, _mm256, KWEIGHT_ABS256)
+KWEIGHT_KERNEL(kweight_avx512, "avx512f", 8, __m512d, _mm512, KWEIGHT_ABS512)
+
+#endif
+
+static const kweight_kernel kweight_kernels[] = {
+#ifdef KWEIGHT_X86
+	{ "avx512", 8, kweight_avx512 },
+	{ "avx2",   4, kweight_avx2   },
+	{ "sse2",   2, kweight_sse2   },
+#endif
+	{ "scalar", 1, kweight_scalar },
+};
+
+#define KWEIGHT_NB_KERNELS (sizeof(kweight_kernels) / sizeof(kweight_kernels[0]))
+
+static int kweight_supported(const kweight_kernel *kern) {
+#ifdef KWEIGHT_X86
+	if (kern -> filter == kweight_avx512)
+		return __builtin_cpu_supports("avx512f");
+
+	if (kern -> filter == kweight_avx2)
+		return __builtin_cpu_supports("avx2");
+
+	if (kern -> filter == kweight_sse2)
+		return __builtin_cpu_supports("sse2");
+#endif
+
+	return 1;
+}
+
+/* The kernel called name, if this CPU can run it. */
+const kweight_kernel *kweight_find(const char *name) {
+	size_t i;
+
+	for (i = 0; i < KWEIGHT_NB_KERNELS; i++) {
+		if (strcmp(kweight_kernels[i].name, name) == 0)
+			return kweight_supported(&kweight_kernels[i]) ? &kweight_kernels[i]
+			                                                : NULL;
+	}
+
+	return NULL;
+}
+
+/*
+ * The narrowest supported kernel that still takes all channels in one
+ * vector (the widest one, for more channels): stereo gains nothing from
+ * 8 lanes, and wide vectors can lower the clock on some CPUs.
+ */
+const kweight_kernel *kweight_best(unsigned channels) {
+	const kweight_kernel *best = NULL;
+	size_t i;
+
+	for (i = 0; i < KWEIGHT_NB_KERNELS; i++) {
+		if (!kweight_supported(&kweight_kernels[i]))
+			continue;
+
+		if (best == NULL || kweight_kernels[i].width >= channels)
+			best = &kweight_kernels[i];
+	}
+
+	return best;
+}
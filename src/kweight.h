@@ -0,0 +1,70 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * K-weighting (BS.1770 pre-filter and RLB high-pass, combined into one
+ * fourth-order filter the way libebur128 does it) over several channels at
+ * once. Samples are interleaved doubles, `lanes` per frame; a kernel
+ * filters `width` channels per vector, so lanes must be a multiple of the
+ * width (unused lanes are simply zero). Every kernel computes exactly the
+ * same operations in the same order, so all of them give the same results.
+ */
+typedef struct {
+	double b[5];
+	double a[5];
+} kweight_coeffs;
+
+/*
+ * Filters nb frames of x, with the filter state v (lanes values for each of
+ * v[1] .. v[4], at v + k * lanes). Adds the squared output of every lane to
+ * sum, and raises peak to the highest absolute input sample of every lane.
+ */
+typedef void (*kweight_fn)(const kweight_coeffs *k, double *v,
+                           const double *x, size_t lanes, size_t nb,
+                           double *sum, double *peak);
+
+typedef struct {
+	const char *name;
+	unsigned    width;          // channels per vector
+	kweight_fn  filter;
+} kweight_kernel;
+
+void kweight_init(kweight_coeffs *k, unsigned long samplerate);
+
+const kweight_kernel *kweight_find(const char *name);
+const kweight_kernel *kweight_best(unsigned channels);
+
+#ifdef __cplusplus
+}
+#endif
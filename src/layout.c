@@ -0,0 +1,154 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#include <linux/fiemap.h>
+#endif
+
+#include "layout.h"
+#include "printf.h"
+
+static int layout_extent(int fd, unsigned long long *pos);
+
+void layout_get(const char *file, unsigned index, layout_key *key) {
+	struct stat st;
+	int fd;
+
+	memset(key, 0, sizeof(layout_key));
+
+	key -> kind  = LAYOUT_UNKNOWN;
+	key -> index = index;
+
+	fd = open(file, O_RDONLY);
+	if (fd < 0)
+		return;
+
+	if (fstat(fd, &st) == 0) {
+		key -> dev  = st.st_dev;
+		key -> kind = LAYOUT_INODE;
+		key -> pos  = st.st_ino;
+
+		if (S_ISREG(st.st_mode) && layout_extent(fd, &key -> pos) == 0)
+			key -> kind = LAYOUT_EXTENT;
+	}
+
+	close(fd);
+}
+
+/* For qsort(): by device, then by position; equal keys keep list order. */
+int layout_cmp(const void *a, const void *b) {
+	const layout_key *x = a, *y = b;
+
+	if (x -> kind == LAYOUT_UNKNOWN || y -> kind == LAYOUT_UNKNOWN) {
+		if (x -> kind != y -> kind)
+			return (x -> kind == LAYOUT_UNKNOWN) ? 1 : -1;
+	} else if (x -> dev != y -> dev) {
+		return (x -> dev < y -> dev) ? -1 : 1;
+	}
+
+	if (x -> kind != y -> kind)
+		return (x -> kind < y -> kind) ? -1 : 1;
+
+	if (x -> pos != y -> pos)
+		return (x -> pos < y -> pos) ? -1 : 1;
+
+	return (x -> index < y -> index) ? -1 : (x -> index > y -> index);
+}
+
+void layout_sort(char * const *files, unsigned nb_files, unsigned *order,
+                 layout_key *first) {
+	layout_key *keys;
+	unsigned i;
+
+	keys = malloc(sizeof(layout_key) * (nb_files ? nb_files : 1));
+	if (keys == NULL)
+		fail_printf("OOM");
+
+	for (i = 0; i < nb_files; i++)
+		layout_get(files[i], i, &keys[i]);
+
+	qsort(keys, nb_files, sizeof(layout_key), layout_cmp);
+
+	for (i = 0; i < nb_files; i++)
+		order[i] = keys[i].index;
+
+	if (first != NULL && nb_files > 0) {
+		*first = keys[0];
+	} else if (first != NULL) {
+		memset(first, 0, sizeof(layout_key));
+		first -> kind = LAYOUT_UNKNOWN;
+	}
+
+	free(keys);
+}
+
+/* Physical offset of the first extent, if the file system maps it (not
+ * delayed allocation, not inline in the metadata). Without FIEMAP (other
+ * kernels, NFS, FUSE) this fails and the inode is used. */
+static int layout_extent(int fd, unsigned long long *pos) {
+#ifdef FS_IOC_FIEMAP
+	union {
+		struct fiemap map;
+		char          buf[sizeof(struct fiemap) +
+		                  sizeof(struct fiemap_extent)];
+	} req;
+	const struct fiemap_extent *ext = req.map.fm_extents;
+
+	memset(&req, 0, sizeof(req));
+
+	req.map.fm_start        = 0;
+	req.map.fm_length       = FIEMAP_MAX_OFFSET;
+	req.map.fm_extent_count = 1;
+
+	if (ioctl(fd, FS_IOC_FIEMAP, &req.map) < 0 ||
+	    req.map.fm_mapped_extents == 0)
+		return -1;
+
+	if (ext -> fe_flags & (FIEMAP_EXTENT_UNKNOWN |
+	                       FIEMAP_EXTENT_DELALLOC |
+	                       FIEMAP_EXTENT_DATA_INLINE))
+		return -1;
+
+	*pos = ext -> fe_physical;
+	return 0;
+#else
+	(void) fd;
+	(void) pos;
+	return -1;
+#endif
+}
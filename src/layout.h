@@ -0,0 +1,58 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Where a file lies on its device, to scan files in disk order: the
+ * physical offset of its first extent (FIEMAP) where the file system
+ * tells, else its inode number, which most file systems allocate close to
+ * the data. Files that cannot be looked at sort last. */
+enum { LAYOUT_EXTENT, LAYOUT_INODE, LAYOUT_UNKNOWN };
+
+typedef struct {
+	unsigned long long  dev;
+	int                 kind;
+	unsigned long long  pos;    // byte offset on the device, or inode
+	unsigned            index;  // position in the caller's list
+} layout_key;
+
+void layout_get(const char *file, unsigned index, layout_key *key);
+int layout_cmp(const void *a, const void *b);
+
+/* Fills order with the indexes of files, in the order they lie on disk;
+ * first (if not NULL) gets the key of the file that comes first. */
+void layout_sort(char * const *files, unsigned nb_files, unsigned *order,
+                 layout_key *first);
+
+#ifdef __cplusplus
+}
+#endif
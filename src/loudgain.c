@@ -80,8 +80,12 @@
 #include "scan.h"
 #include "tag.h"
 #include "printf.h"
+#include "pool.h"
+#include "walk.h"
+#include "prefetch.h"
+#include "layout.h"
 
-const char *short_opts = "rackK:d:oOqs:LSI:h?v";
+const char *short_opts = "rackK:d:oOqs:LSI:j:PT:He:p:b:NW:DXRE:Fh?v";
 
 static struct option long_opts[] = {
 	{ "track",        no_argument,       NULL, 'r' },
@@ -102,6 +106,22 @@ static struct option long_opts[] = {
 	{ "striptags",    no_argument,       NULL, 'S' },
 	{ "id3v2version", required_argument, NULL, 'I' },
 
+	{ "jobs",         required_argument, NULL, 'j' },
+	{ "pipeline",     no_argument,       NULL, 'P' },
+	{ "segments",     required_argument, NULL, 'T' },
+	{ "histogram",    no_argument,       NULL, 'H' },
+	{ "engine",       required_argument, NULL, 'e' },
+	{ "profile",      required_argument, NULL, 'p' },
+	{ "read",         required_argument, NULL, 'b' },
+	{ "nocache",      no_argument,       NULL, 'N' },
+	{ "prefetch",     required_argument, NULL, 'W' },
+	{ "disk-order",   no_argument,       NULL, 'D' },
+	{ "stats",        no_argument,       NULL, 'X' },
+
+	{ "recursive",    no_argument,       NULL, 'R' },
+	{ "exclude",      required_argument, NULL, 'E' },
+	{ "follow-links", no_argument,       NULL, 'F' },
+
 	{ "help",         no_argument,       NULL, 'h' },
 	{ "version",      no_argument,       NULL, 'v' },
 	{ 0, 0, 0, 0 }
@@ -153,28 +173,133 @@ char     swr_version[15] = "";
 unsigned lavf_ver         = 0;
 char     lavf_version[15] = "";
 
+/* Settings for everything after the scan: gain, clipping, tags, output. */
+typedef struct {
+	char     mode;
+	char     unit[3];
+	double   pre_gain;
+	double   max_true_peak_level; // dBTP; default for -k, as per EBU Tech 3343
+	bool     no_clip;
+	bool     warn_clip;
+	bool     do_album;
+	bool     tab_output;
+	bool     tab_output_new;
+	bool     lowercase;   // force MP3 ID3v2 tags to lowercase?
+	bool     strip;       // MP3 ID3v2: strip other tag types?
+	int      id3v2version; // MP3 ID3v2 version to write; can be 3 or 4
+	bool     show_stats;  // print scanner statistics per file
+	bool     keep_going;  // -R: report a bad album and go on with the next
+	int      measures;    // what the analysis profile measures (SCAN_*)
+} result_opts;
+
+/* Options per file type in recursive mode (-R), the same rgbpm2 uses.
+ * Every album gets '-a -k -s e' on top. */
+typedef struct {
+	const char *ext;
+	int         id3v2version; // 0: as given
+	bool        strip;
+	bool        lowercase;
+} ext_opts;
+
+// '.mp4' deliberately left out: these are doable but usually videos
+static const ext_opts ext_table[] = {
+	{ ".flac", 0, false, false },
+	{ ".ogg",  0, false, false },
+	{ ".oga",  0, false, false },
+	{ ".spx",  0, false, false },
+	{ ".opus", 0, false, false },
+	{ ".mp2",  3, true,  true  },
+	{ ".mp3",  3, true,  true  },
+	{ ".m4a",  0, false, true  },
+	{ ".wma",  0, false, true  },
+	{ ".asf",  0, false, true  },
+	{ ".wav",  3, false, true  },
+	{ ".aif",  3, false, true  },
+	{ ".aiff", 3, false, true  },
+	{ ".wv",   0, true,  false },
+	{ ".ape",  0, true,  false },
+};
+
+#define NB_EXTS (sizeof(ext_table) / sizeof(ext_table[0]))
+
+// exclude all folders ending in '[compilations]' (fnmatch syntax)
+static const char *default_excludes[] = { "*[[]compilations[]]", NULL };
+
+/* Files that are scanned and reported together (with -a, as one album).
+ * Whoever scans the last track finishes the album right away: album
+ * values, tags and output. */
+typedef struct {
+	scan_ctx          *ctx;
+	char             **files;
+	unsigned           nb_files;
+	unsigned           pending;   // tracks not scanned yet
+	result_opts       *opts;
+} album;
+
+typedef struct {
+	album      *album;
+	unsigned    index;
+	prefetch   *prefetch;     // NULL: files are not warmed up
+	unsigned    seq;          // position in the prefetch list
+} scan_job;
+
+/* A track result, after clipping prevention. */
+typedef struct {
+	scan_result *scan;
+	bool         will_clip;
+	bool         tclip;
+	bool         aclip;
+	double       tnew;
+	double       anew;
+	double       again;
+	double       apeak;
+} track_result;
+
+static void scan_folders(char **folders, unsigned nb_folders,
+                         const result_opts *opts, scan_options scan_opts,
+                         unsigned jobs, unsigned long long prefetch_budget,
+                         bool disk_order, const char **excludes,
+                         bool follow_links);
+static void scan_job_run(void *arg);
+static void album_finish(album *a);
+static void prevent_clipping(const result_opts *opts, track_result *t);
+static void write_tags(result_opts *opts, scan_result *scan);
+static void print_header(const result_opts *opts);
+static void print_result(const result_opts *opts, const track_result *t,
+                         bool last);
+static void print_stats(const char *file, const scan_stats *stats);
+static void prefetch_finish(prefetch *p, const result_opts *opts);
+
 static inline void help(void);
 static inline void version(void);
 
 int main(int argc, char *argv[]) {
 	int rc, i;
 
-	char mode           = 's';
-	char unit[3]        = "dB";
-
 	unsigned nb_files   = 0;
-
-	double pre_gain     = 0.f;
-	double max_true_peak_level = -1.0; // dBTP; default for -k, as per EBU Tech 3343
-
-	bool no_clip        = false;
-	bool warn_clip      = true;
-	bool do_album       = false;
-	bool tab_output     = false;
-	bool tab_output_new = false;
-	bool lowercase      = false; // force MP3 ID3v2 tags to lowercase?
-	bool strip          = false; // MP3 ID3v2: strip other tag types?
-	int  id3v2version   = 4;     // MP3 ID3v2 version to write; can be 3 or 4
+	unsigned jobs       = 0;     // number of files to scan in parallel (0: default)
+	unsigned long long prefetch_budget = 0; // bytes warmed ahead (0: off)
+	prefetch *warm      = NULL;
+	unsigned *order     = NULL;  // scan order, as indexes into the files
+	char **queued       = NULL;  // the files in scan order, for prefetch
+
+	bool disk_order     = false;
+	bool recursive      = false;
+	bool follow_links   = false;
+	const char **excludes = NULL;
+	unsigned nb_excludes = 0;
+
+	result_opts opts = {
+		.mode                = 's',
+		.unit                = "dB",
+		.pre_gain            = 0.f,
+		.max_true_peak_level = -1.0,
+		.warn_clip           = true,
+		.id3v2version        = 4,
+		.measures            = scan_profile(NULL),
+	};
+	scan_options scan_opts = { 0 };
+	album alb = { 0 };
 
 	// libebur128 version check -- versions before 1.2.4 aren’t recommended
 	ebur128_get_version(&ebur128_v_major, &ebur128_v_minor, &ebur128_v_patch);
@@ -200,49 +325,49 @@ int main(int argc, char *argv[]) {
 				break;
 
 			case 'a':
-				do_album = true;
+				opts.do_album = true;
 				break;
 
 			case 'c':
-				warn_clip = false;
+				opts.warn_clip = false;
 				break;
 
 			case 'k':
 				// old-style, no argument, now defaults to -1 dBTP max. true peak level
-				no_clip = true;
+				opts.no_clip = true;
 				break;
 
 			case 'K': {
 				// new style, argument in dBTP, sets max. true peak level
-				no_clip = true;
+				opts.no_clip = true;
 
 				char *rest = NULL;
-				max_true_peak_level = strtod(optarg, &rest);
+				opts.max_true_peak_level = strtod(optarg, &rest);
 
 				if (!rest ||
 				    (rest == optarg) ||
-				    !isfinite(pre_gain))
+				    !isfinite(opts.pre_gain))
 					fail_printf("Invalid max. true peak level (dBTP)");
 				break;
 			}
 
 			case 'd': {
 				char *rest = NULL;
-				pre_gain = strtod(optarg, &rest);
+				opts.pre_gain = strtod(optarg, &rest);
 
 				if (!rest ||
 				    (rest == optarg) ||
-				    !isfinite(pre_gain))
+				    !isfinite(opts.pre_gain))
 					fail_printf("Invalid pregain value (dB/LU)");
 				break;
 			}
 
 			case 'o':
-				tab_output = true;
+				opts.tab_output = true;
 				break;
 
 			case 'O':
-				tab_output_new = true;
+				opts.tab_output_new = true;
 				break;
 
 			case 'q':
@@ -252,29 +377,142 @@ int main(int argc, char *argv[]) {
 			case 's': {
 				// for mp3gain compatibilty, include modes that do nothing
 				char *valid_modes = "cdielavsr";
-				mode = optarg[0];
-				if (strchr(valid_modes, mode) == NULL)
-					fail_printf("Invalid tag mode: '%c'", mode);
-				if (mode == 'l') {
-					strcpy(unit, "LU");
+				opts.mode = optarg[0];
+				if (strchr(valid_modes, opts.mode) == NULL)
+					fail_printf("Invalid tag mode: '%c'", opts.mode);
+				if (opts.mode == 'l') {
+					strcpy(opts.unit, "LU");
 				}
 				break;
 			}
 
 			case 'L':
-				lowercase = true;
+				opts.lowercase = true;
 				break;
 
 			case 'S':
-				strip = true;
+				opts.strip = true;
 				break;
 
 			case 'I':
-				id3v2version = atoi(optarg);
-				if (!(id3v2version == 3) && !(id3v2version == 4))
+				opts.id3v2version = atoi(optarg);
+				if (!(opts.id3v2version == 3) && !(opts.id3v2version == 4))
 					fail_printf("Invalid ID3v2 version; only 3 and 4 are supported.");
 				break;
 
+			case 'j': {
+				// 0 means "one job per online CPU"
+				char *rest = NULL;
+				long n = strtol(optarg, &rest, 10);
+
+				if (!rest || (rest == optarg) || (*rest != '\0') || (n < 0))
+					fail_printf("Invalid number of jobs");
+
+				jobs = (n == 0) ? pool_nb_cpus() : (unsigned) n;
+				break;
+			}
+
+			case 'R':
+				recursive = true;
+				break;
+
+			case 'E':
+				// NULL terminated, replaces the default list
+				excludes = realloc(excludes, sizeof(char *) * (nb_excludes + 2));
+				if (excludes == NULL)
+					fail_printf("OOM");
+
+				excludes[nb_excludes++] = optarg;
+				excludes[nb_excludes]   = NULL;
+				break;
+
+			case 'F':
+				follow_links = true;
+				break;
+
+			case 'P':
+				scan_opts.pipeline = 1;
+				break;
+
+			case 'T': {
+				// 0 means "one segment per online CPU"
+				char *rest = NULL;
+				long n = strtol(optarg, &rest, 10);
+
+				if (!rest || (rest == optarg) || (*rest != '\0') || (n < 0))
+					fail_printf("Invalid number of segments");
+
+				scan_opts.segments = (n == 0) ? pool_nb_cpus() : (unsigned) n;
+				break;
+			}
+
+			case 'H':
+				scan_opts.histogram = 1;
+				break;
+
+			case 'e':
+				if (!scan_engine_valid(optarg))
+					fail_printf("Invalid or unsupported loudness engine: %s", optarg);
+
+				scan_opts.engine = optarg;
+				break;
+
+			case 'p':
+				opts.measures = scan_profile(optarg);
+				if (opts.measures < 0)
+					fail_printf("Invalid analysis profile: %s", optarg);
+
+				scan_opts.profile = optarg;
+				break;
+
+			case 'b': {
+				// block size in KiB, "mmap" or "uring"
+				char *rest = NULL;
+				long n;
+
+				if (strcmp(optarg, "mmap") == 0) {
+					scan_opts.read_mode = SCAN_READ_MMAP;
+					break;
+				}
+
+				if (strcmp(optarg, "uring") == 0) {
+					scan_opts.read_mode = SCAN_READ_URING;
+					break;
+				}
+
+				n = strtol(optarg, &rest, 10);
+
+				if (!rest || (rest == optarg) || (*rest != '\0') || (n < 4))
+					fail_printf("Invalid read block size (KiB, at least 4)");
+
+				scan_opts.read_size = (size_t) n * 1024;
+				break;
+			}
+
+			case 'N':
+				scan_opts.no_cache = 1;
+				break;
+
+			case 'W': {
+				// MiB, 0 means "off"
+				char *rest = NULL;
+				long n = strtol(optarg, &rest, 10);
+
+				if (!rest || (rest == optarg) || (*rest != '\0') || (n < 0))
+					fail_printf("Invalid prefetch budget (MiB)");
+
+				prefetch_budget = (unsigned long long) n * 1024 * 1024;
+				break;
+			}
+
+			case 'D':
+				disk_order = true;
+				break;
+
+			case 'X':
+				opts.show_stats = true;
+				break;
+
 			case '?':
 				if (optopt == 0) {
 					// actual option '-?'
@@ -294,366 +532,788 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
+	// -R always prevents clipping
+	if ((opts.no_clip || recursive) && !(opts.measures & SCAN_PEAKS))
+		warn_printf("No peaks are measured, clipping cannot be prevented");
+
+	if (recursive) {
+		// like rgbpm2: as many jobs as CPUs unless told otherwise
+		scan_folders(argv + optind, argc - optind, &opts, scan_opts,
+		             jobs ? jobs : pool_nb_cpus(), prefetch_budget, disk_order,
+		             excludes ? excludes : default_excludes, follow_links);
+
+		free(excludes);
+		return 0;
+	}
+
+	if (jobs == 0)
+		jobs = 1;
+
 	nb_files = argc - optind;
 
-	scan_init(nb_files);
+	// without album values, nothing but the track values is kept per file
+	scan_opts.track_only = !opts.do_album;
+
+	alb.ctx      = scan_init(nb_files);
+	alb.files    = argv + optind;
+	alb.nb_files = nb_files;
+	alb.pending  = nb_files;
+	alb.opts     = &opts;
+
+	if (jobs > nb_files)
+		jobs = nb_files;
+
+	// multichannel files share the CPUs with the other jobs
+	scan_opts.jobs = jobs;
+
+	scan_set_options(alb.ctx, &scan_opts);
+
+	// results keep their slot, so the scan order never shows in the output
+	order = malloc(sizeof(unsigned) * (nb_files ? nb_files : 1));
+	if (order == NULL)
+		fail_printf("OOM");
+
+	if (disk_order) {
+		layout_sort(alb.files, nb_files, order, NULL);
+	} else {
+		for (i = 0; i < nb_files; i++)
+			order[i] = i;
+	}
+
+	if (prefetch_budget > 0 && nb_files > 1) {
+		queued = malloc(sizeof(char *) * nb_files);
+		if (queued == NULL)
+			fail_printf("OOM");
+
+		for (i = 0; i < nb_files; i++)
+			queued[i] = alb.files[order[i]];
+
+		warm = prefetch_new(queued, nb_files, prefetch_budget,
+		                    scan_opts.no_cache);
+	}
+
+	if (nb_files == 0) {
+		// nothing to scan, but still print the list header
+		album_finish(&alb);
+	} else if (jobs > 1) {
+		// Each file has its own result slot, so workers never share state.
+		// Results are still reported in command line order.
+		scan_job *queue = malloc(sizeof(scan_job) * nb_files);
+		if (queue == NULL)
+			fail_printf("OOM");
+
+		// interleaved progress bars from several workers are just noise
+		no_progress = 1;
+
+		pool *workers = pool_new(jobs);
+
+		for (i = 0; i < nb_files; i++) {
+			queue[i].album    = &alb;
+			queue[i].index    = order[i];
+			queue[i].prefetch = warm;
+			queue[i].seq      = i;
+			pool_submit(workers, scan_job_run, &queue[i]);
+		}
+
+		pool_wait(workers);
+		pool_free(workers);
+		free(queue);
+	} else {
+		for (i = 0; i < nb_files; i++) {
+			scan_job job = { &alb, order[i], warm, i };
+
+			scan_job_run(&job);
+		}
+	}
+
+	if (warm != NULL)
+		prefetch_finish(warm, &opts);
+
+	free(queued);
+	free(order);
+
+	return 0;
+}
+
+/*
+ * Recursive mode: files of the same type in the same folder are an album,
+ * and every album is tagged with the options of its file type. All tracks
+ * of all albums go to one pool; each album is finished as soon as its last
+ * track is done, so finished albums are released while others are still
+ * being scanned. In disk order (-D), albums are queued by where their first
+ * track lies and tracks by where they lie; albums stay as they were.
+ */
+static void scan_folders(char **folders, unsigned nb_folders,
+                         const result_opts *opts, scan_options scan_opts,
+                         unsigned jobs, unsigned long long prefetch_budget,
+                         bool disk_order, const char **excludes,
+                         bool follow_links) {
+	const char *exts[NB_EXTS + 1];
+	result_opts type_opts[NB_EXTS];
+	walk_result tree = { 0 };
+	album *albums;
+	scan_job *queue;
+	unsigned *group_order, *file_order, *first;
+	layout_key *keys = NULL;
+	char **order = NULL;
+	prefetch *warm = NULL;
+	pool *workers;
+	unsigned i, j, k;
+
+	for (i = 0; i < NB_EXTS; i++) {
+		exts[i] = ext_table[i].ext;
+
+		type_opts[i] = *opts;
+		type_opts[i].do_album   = true;
+		type_opts[i].no_clip    = true;
+		type_opts[i].mode       = 'e';
+		type_opts[i].keep_going = true;
+		type_opts[i].strip     |= ext_table[i].strip;
+		type_opts[i].lowercase |= ext_table[i].lowercase;
+		strcpy(type_opts[i].unit, "dB");
+
+		if (ext_table[i].id3v2version != 0)
+			type_opts[i].id3v2version = ext_table[i].id3v2version;
+	}
+
+	exts[NB_EXTS] = NULL;
+
+	for (i = 0; i < nb_folders; i++) {
+		if (walk_tree(folders[i], exts, excludes, follow_links, &tree) < 0)
+			err_printf("Could not read folder %s", folders[i]);
+	}
+
+	ok_printf("Excluded %u folders.", tree.nb_excluded);
+	ok_printf("Working on %u files in %u albums.", tree.nb_files, tree.nb_groups);
+
+	albums = calloc(tree.nb_groups ? tree.nb_groups : 1, sizeof(album));
+	queue  = malloc(sizeof(scan_job) * (tree.nb_files ? tree.nb_files : 1));
+	if (albums == NULL || queue == NULL)
+		fail_printf("OOM");
+
+	// scan order: group_order lists the albums, file_order the tracks of
+	// album i from first[i] on
+	group_order = malloc(sizeof(unsigned) * (tree.nb_groups ? tree.nb_groups : 1));
+	first       = malloc(sizeof(unsigned) * (tree.nb_groups ? tree.nb_groups : 1));
+	file_order  = malloc(sizeof(unsigned) * (tree.nb_files ? tree.nb_files : 1));
+	if (group_order == NULL || first == NULL || file_order == NULL)
+		fail_printf("OOM");
+
+	if (disk_order) {
+		keys = malloc(sizeof(layout_key) * (tree.nb_groups ? tree.nb_groups : 1));
+		if (keys == NULL)
+			fail_printf("OOM");
+	}
+
+	for (i = 0, k = 0; i < tree.nb_groups; k += tree.groups[i].nb_files, i++) {
+		walk_group *g = &tree.groups[i];
+
+		first[i] = k;
+
+		if (disk_order) {
+			layout_sort(g -> files, g -> nb_files, file_order + k, &keys[i]);
+			keys[i].index = i;
+		} else {
+			for (j = 0; j < g -> nb_files; j++)
+				file_order[k + j] = j;
+		}
+	}
+
+	if (disk_order)
+		qsort(keys, tree.nb_groups, sizeof(layout_key), layout_cmp);
+
+	for (i = 0; i < tree.nb_groups; i++)
+		group_order[i] = disk_order ? keys[i].index : i;
+
+	free(keys);
+
+	// an unreadable file must not end the whole run
+	scan_opts.keep_going = 1;
+	scan_opts.jobs       = jobs;
 
-	for (i = optind; i < argc; i++) {
-		ok_printf("Scanning '%s' ...", argv[i]);
+	if (jobs > 1)
+		no_progress = 1;
 
-		scan_file(argv[i], i - optind);
+	// files are warmed in the order they are queued: album by album
+	if (prefetch_budget > 0 && tree.nb_files > 1) {
+		order = malloc(sizeof(char *) * tree.nb_files);
+		if (order == NULL)
+			fail_printf("OOM");
+
+		for (i = 0, k = 0; i < tree.nb_groups; i++) {
+			walk_group *g = &tree.groups[group_order[i]];
+			unsigned *files = file_order + first[group_order[i]];
+
+			for (j = 0; j < g -> nb_files; j++)
+				order[k++] = g -> files[files[j]];
+		}
+
+		warm = prefetch_new(order, tree.nb_files, prefetch_budget,
+		                    scan_opts.no_cache);
 	}
 
+	workers = pool_new(jobs);
+
+	for (i = 0, k = 0; i < tree.nb_groups; i++) {
+		walk_group *g = &tree.groups[group_order[i]];
+		album *a = &albums[group_order[i]];
+		unsigned *files = file_order + first[group_order[i]];
+
+		for (j = 0; j < NB_EXTS; j++) {
+			if (g -> ext == exts[j])
+				a -> opts = &type_opts[j];
+		}
+
+		a -> ctx      = scan_init(g -> nb_files);
+		a -> files    = g -> files;
+		a -> nb_files = g -> nb_files;
+		a -> pending  = g -> nb_files;
+
+		scan_set_options(a -> ctx, &scan_opts);
+
+		for (j = 0; j < g -> nb_files; j++, k++) {
+			queue[k].album    = a;
+			queue[k].index    = files[j];
+			queue[k].prefetch = warm;
+			queue[k].seq      = k;
+			pool_submit(workers, scan_job_run, &queue[k]);
+		}
+	}
+
+	pool_wait(workers);
+	pool_free(workers);
+
+	if (warm != NULL)
+		prefetch_finish(warm, opts);
+
+	free(order);
+	free(file_order);
+	free(first);
+	free(group_order);
+	free(queue);
+	free(albums);
+	walk_free(&tree);
+}
+
+static void scan_job_run(void *arg) {
+	scan_job *job = arg;
+	album *a = job -> album;
+
+	ok_printf("Scanning '%s' ...", a -> files[job -> index]);
+
+	scan_file(a -> ctx, a -> files[job -> index], job -> index);
+
+	if (job -> prefetch != NULL)
+		prefetch_done(job -> prefetch, job -> seq);
+
+	// the last track of an album finishes it, on this thread
+	if (__atomic_sub_fetch(&a -> pending, 1, __ATOMIC_ACQ_REL) == 0)
+		album_finish(a);
+}
+
+static void album_finish(album *a) {
+	result_opts *opts = a -> opts;
+	track_result *tracks;
+	unsigned i, last = 0;
+
 	// check for different file (codec) types in an album and warn
 	// (including Opus might mess up album gain)
-	if (do_album) {
-		if (scan_album_has_different_containers() || scan_album_has_different_codecs()) {
+	if (opts -> do_album) {
+		if (scan_album_has_different_containers(a -> ctx) || scan_album_has_different_codecs(a -> ctx)) {
 			warn_printf("You have different file types in the same album!");
-			if (scan_album_has_opus())
-				fail_printf("Cannot calculate correct album gain when mixing Opus and non-Opus files!");
+			if (scan_album_has_opus(a -> ctx)) {
+				if (!opts -> keep_going)
+					fail_printf("Cannot calculate correct album gain when mixing Opus and non-Opus files!");
+
+				err_printf("Cannot calculate correct album gain when mixing Opus and non-Opus files, skipping %s", a -> files[0]);
+
+				scan_deinit(a -> ctx);
+				a -> ctx = NULL;
+				return;
+			}
 		}
 	}
 
-	if (tab_output)
-		printf("File\tMP3 gain\tdB gain\tMax Amplitude\tMax global_gain\tMin global_gain\n");
+	tracks = calloc(a -> nb_files ? a -> nb_files : 1, sizeof(track_result));
+	if (tracks == NULL)
+		fail_printf("OOM");
 
-	if (tab_output_new)
-		printf("File\tLoudness\tRange\tTrue_Peak\tTrue_Peak_dBTP\tReference\tWill_clip\tClip_prevent\tGain\tNew_Peak\tNew_Peak_dBTP\n");
+	for (i = 0; i < a -> nb_files; i++) {
+		track_result *t = &tracks[i];
+
+		t -> scan = scan_get_track_result(a -> ctx, i, opts -> pre_gain);
+
+		if (t -> scan == NULL)
+			continue;
+
+		last = i;
+
+		if (opts -> do_album)
+			scan_set_album_result(a -> ctx, t -> scan, opts -> pre_gain);
+
+		prevent_clipping(opts, t);
+		write_tags(opts, t -> scan);
+	}
 
-	for (i = 0; i < nb_files; i++) {
-		bool will_clip = false;
-		double tgain = 1.0; // "gained" track peak
-		double tnew;
-		double tpeak = pow(10.0, max_true_peak_level / 20.0); // track peak limit
-		double again = 1.0; // "gained" album peak
-		double anew;
-		double apeak = pow(10.0, max_true_peak_level / 20.0); // album peak limit
-		bool tclip = false;
-		bool aclip = false;
+	// albums finishing on other threads must wait for their turn
+	flockfile(stdout);
 
-		scan_result *scan = scan_get_track_result(i, pre_gain);
+	print_header(opts);
 
-		if (scan == NULL)
+	for (i = 0; i < a -> nb_files; i++) {
+		if (tracks[i].scan == NULL)
 			continue;
 
-		if (do_album)
-			scan_set_album_result(scan, pre_gain);
+		print_result(opts, &tracks[i], i == last);
 
-		// Check if track or album will clip, and correct if so requested (-k/-K)
+		if (opts -> show_stats)
+			print_stats(tracks[i].scan -> file, scan_get_stats(a -> ctx, i));
 
-		// track peak after gain
-		tgain = pow(10.0, scan -> track_gain / 20.0) * scan -> track_peak;
-		tnew = tgain;
-		if (do_album) {
-			// album peak after gain
-			again = pow(10.0, scan -> album_gain / 20.0) * scan -> album_peak;
-			anew = again;
+		free(tracks[i].scan);
+	}
+
+	fflush(stdout);
+	funlockfile(stdout);
+
+	free(tracks);
+
+	scan_deinit(a -> ctx);
+	a -> ctx = NULL;
+}
+
+// Check if track or album will clip, and correct if so requested (-k/-K)
+static void prevent_clipping(const result_opts *opts, track_result *t) {
+	scan_result *scan = t -> scan;
+
+	double tgain = 1.0; // "gained" track peak
+	double tpeak = pow(10.0, opts -> max_true_peak_level / 20.0); // track peak limit
+
+	t -> again = 1.0; // "gained" album peak
+	t -> apeak = pow(10.0, opts -> max_true_peak_level / 20.0); // album peak limit
+
+	// without peaks (analysis profile), nothing is known about clipping
+	if (!(scan -> measured & SCAN_PEAKS))
+		return;
+
+	// track peak after gain
+	tgain = pow(10.0, scan -> track_gain / 20.0) * scan -> track_peak;
+	t -> tnew = tgain;
+	if (opts -> do_album) {
+		// album peak after gain
+		t -> again = pow(10.0, scan -> album_gain / 20.0) * scan -> album_peak;
+		t -> anew = t -> again;
+	}
+
+	if ((tgain > tpeak) || (opts -> do_album && (t -> again > t -> apeak)))
+		t -> will_clip = true;
+
+	// printf("\ntrack: %.2f LU, peak %.6f; album: %.2f LU, peak %.6f\ntrack: %.6f, %.6f; album: %.6f, %.6f; Clip: %s\n",
+	// 	scan -> track_gain, scan -> track_peak, scan -> album_gain, scan -> album_peak,
+	// 	tgain, tpeak, again, apeak, will_clip ? "Yes" : "No");
+
+	if (t -> will_clip && opts -> no_clip) {
+		if (tgain > tpeak) {
+			// set new track peak = minimum of peak after gain and peak limit
+			t -> tnew = FFMIN(tgain, tpeak);
+			scan -> track_gain = scan -> track_gain - (log10(tgain / t -> tnew) * 20.0);
+			t -> tclip = true;
 		}
 
-		if ((tgain > tpeak) || (do_album && (again > apeak)))
-			will_clip = true;
+		if (opts -> do_album && (t -> again > t -> apeak)) {
+			t -> anew = FFMIN(t -> again, t -> apeak);
+			scan -> album_gain = scan -> album_gain - (log10(t -> again / t -> anew) * 20.0);
+			t -> aclip = true;
+		}
+
+		t -> will_clip = false;
 
-		// printf("\ntrack: %.2f LU, peak %.6f; album: %.2f LU, peak %.6f\ntrack: %.6f, %.6f; album: %.6f, %.6f; Clip: %s\n",
+		// printf("\nAfter clipping prevention:\ntrack: %.2f LU, peak %.6f; album: %.2f LU, peak %.6f\ntrack: %.6f, %.6f; album: %.6f, %.6f; Clip: %s\n",
 		// 	scan -> track_gain, scan -> track_peak, scan -> album_gain, scan -> album_peak,
 		// 	tgain, tpeak, again, apeak, will_clip ? "Yes" : "No");
+	}
+}
 
-		if (will_clip && no_clip) {
-			if (tgain > tpeak) {
-				// set new track peak = minimum of peak after gain and peak limit
-				tnew = FFMIN(tgain, tpeak);
-				scan -> track_gain = scan -> track_gain - (log10(tgain/tnew) * 20.0);
-				tclip = true;
+static void write_tags(result_opts *opts, scan_result *scan) {
+	switch (opts -> mode) {
+		case 'c': /* check tags */
+			break;
+
+		case 'd': /* delete tags */
+			switch (name_to_id(scan -> container)) {
+
+				case AV_CONTAINER_ID_MP3:
+					if (!tag_clear_mp3(scan, opts -> strip, opts -> id3v2version))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_FLAC:
+					if (!tag_clear_flac(scan))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_OGG:
+					// must separate because TagLib uses fifferent File classes
+					switch (scan->codec_id) {
+						// Opus needs special handling (different RG tags, -23 LUFS ref.)
+						case AV_CODEC_ID_OPUS:
+							if (!tag_clear_ogg_opus(scan))
+								err_printf("Couldn't write to: %s", scan -> file);
+							break;
+
+						case AV_CODEC_ID_VORBIS:
+							if (!tag_clear_ogg_vorbis(scan))
+								err_printf("Couldn't write to: %s", scan -> file);
+							break;
+
+						case AV_CODEC_ID_FLAC:
+							if (!tag_clear_ogg_flac(scan))
+								err_printf("Couldn't write to: %s", scan -> file);
+							break;
+
+						case AV_CODEC_ID_SPEEX:
+							if (!tag_clear_ogg_speex(scan))
+								err_printf("Couldn't write to: %s", scan -> file);
+							break;
+
+						default:
+							err_printf("Codec 0x%x in %s container not supported",
+								scan->codec_id, scan->container);
+							break;
+					}
+					break;
+
+				case AV_CONTAINER_ID_MP4:
+					if (!tag_clear_mp4(scan))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_ASF:
+					if (!tag_clear_asf(scan))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_WAV:
+					if (!tag_clear_wav(scan, opts -> strip, opts -> id3v2version))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_AIFF:
+					if (!tag_clear_aiff(scan, opts -> strip, opts -> id3v2version))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_WV:
+					if (!tag_clear_wavpack(scan, opts -> strip))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_APE:
+					if (!tag_clear_ape(scan, opts -> strip))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				default:
+					err_printf("File type not supported: %s", scan->container);
+					break;
 			}
-
-			if (do_album && (again > apeak)) {
-				anew = FFMIN(again, apeak);
-				scan -> album_gain = scan -> album_gain - (log10(again/anew) * 20.0);
-				aclip = true;
+			break;
+
+		case 'i': /* ID3v2 tags */
+		case 'e': /* same as 'i' plus extra tags */
+		case 'l': /* same as 'e' but in LU/LUFS units (instead of 'dB')*/
+			switch (name_to_id(scan -> container)) {
+
+				case AV_CONTAINER_ID_MP3:
+					if (!tag_write_mp3(scan, opts -> do_album, opts -> mode, opts -> unit, opts -> lowercase, opts -> strip, opts -> id3v2version))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_FLAC:
+					if (!tag_write_flac(scan, opts -> do_album, opts -> mode, opts -> unit))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_OGG:
+					// must separate because TagLib uses fifferent File classes
+					switch (scan->codec_id) {
+						// Opus needs special handling (different RG tags, -23 LUFS ref.)
+						case AV_CODEC_ID_OPUS:
+							if (!tag_write_ogg_opus(scan, opts -> do_album, opts -> mode, opts -> unit))
+								err_printf("Couldn't write to: %s", scan -> file);
+							break;
+
+						case AV_CODEC_ID_VORBIS:
+							if (!tag_write_ogg_vorbis(scan, opts -> do_album, opts -> mode, opts -> unit))
+								err_printf("Couldn't write to: %s", scan -> file);
+							break;
+
+						case AV_CODEC_ID_FLAC:
+							if (!tag_write_ogg_flac(scan, opts -> do_album, opts -> mode, opts -> unit))
+								err_printf("Couldn't write to: %s", scan -> file);
+							break;
+
+						case AV_CODEC_ID_SPEEX:
+							if (!tag_write_ogg_speex(scan, opts -> do_album, opts -> mode, opts -> unit))
+								err_printf("Couldn't write to: %s", scan -> file);
+							break;
+
+						default:
+							err_printf("Codec 0x%x in %s container not supported",
+								scan->codec_id, scan->container);
+							break;
+					}
+					break;
+
+				case AV_CONTAINER_ID_MP4:
+					if (!tag_write_mp4(scan, opts -> do_album, opts -> mode, opts -> unit, opts -> lowercase))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_ASF:
+					if (!tag_write_asf(scan, opts -> do_album, opts -> mode, opts -> unit, opts -> lowercase))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_WAV:
+					if (!tag_write_wav(scan, opts -> do_album, opts -> mode, opts -> unit, opts -> lowercase, opts -> strip, opts -> id3v2version))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_AIFF:
+					if (!tag_write_aiff(scan, opts -> do_album, opts -> mode, opts -> unit, opts -> lowercase, opts -> strip, opts -> id3v2version))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_WV:
+					if (!tag_write_wavpack(scan, opts -> do_album, opts -> mode, opts -> unit, opts -> lowercase, opts -> strip))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				case AV_CONTAINER_ID_APE:
+					if (!tag_write_ape(scan, opts -> do_album, opts -> mode, opts -> unit, opts -> lowercase, opts -> strip))
+						err_printf("Couldn't write to: %s", scan -> file);
+					break;
+
+				default:
+					err_printf("File type not supported: %s", scan->container);
+					break;
 			}
+			break;
 
-			will_clip = false;
+		case 'a': /* APEv2 tags */
+			err_printf("APEv2 tags are not supported");
+			break;
 
-			// printf("\nAfter clipping prevention:\ntrack: %.2f LU, peak %.6f; album: %.2f LU, peak %.6f\ntrack: %.6f, %.6f; album: %.6f, %.6f; Clip: %s\n",
-			// 	scan -> track_gain, scan -> track_peak, scan -> album_gain, scan -> album_peak,
-			// 	tgain, tpeak, again, apeak, will_clip ? "Yes" : "No");
-		}
+		case 'v': /* Vorbis Comments tags */
+			err_printf("Vorbis Comment tags are not supported");
+			break;
 
-		switch (mode) {
-			case 'c': /* check tags */
-				break;
+		case 's': /* skip tags */
+			break;
 
-			case 'd': /* delete tags */
-				switch (name_to_id(scan -> container)) {
-
-					case AV_CONTAINER_ID_MP3:
-						if (!tag_clear_mp3(scan, strip, id3v2version))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_FLAC:
-						if (!tag_clear_flac(scan))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_OGG:
-						// must separate because TagLib uses fifferent File classes
-						switch (scan->codec_id) {
-							// Opus needs special handling (different RG tags, -23 LUFS ref.)
-							case AV_CODEC_ID_OPUS:
-								if (!tag_clear_ogg_opus(scan))
-									err_printf("Couldn't write to: %s", scan -> file);
-								break;
-
-							case AV_CODEC_ID_VORBIS:
-								if (!tag_clear_ogg_vorbis(scan))
-									err_printf("Couldn't write to: %s", scan -> file);
-								break;
-
-							case AV_CODEC_ID_FLAC:
-								if (!tag_clear_ogg_flac(scan))
-									err_printf("Couldn't write to: %s", scan -> file);
-								break;
-
-							case AV_CODEC_ID_SPEEX:
-								if (!tag_clear_ogg_speex(scan))
-									err_printf("Couldn't write to: %s", scan -> file);
-								break;
-
-							default:
-								err_printf("Codec 0x%x in %s container not supported",
-									scan->codec_id, scan->container);
-								break;
-						}
-						break;
-
-					case AV_CONTAINER_ID_MP4:
-						if (!tag_clear_mp4(scan))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_ASF:
-						if (!tag_clear_asf(scan))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_WAV:
-						if (!tag_clear_wav(scan, strip, id3v2version))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_AIFF:
-						if (!tag_clear_aiff(scan, strip, id3v2version))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_WV:
-						if (!tag_clear_wavpack(scan, strip))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_APE:
-						if (!tag_clear_ape(scan, strip))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					default:
-						err_printf("File type not supported: %s", scan->container);
-						break;
-				}
-				break;
+		case 'r': /* force re-calculation */
+			break;
 
-			case 'i': /* ID3v2 tags */
-			case 'e': /* same as 'i' plus extra tags */
-			case 'l': /* same as 'e' but in LU/LUFS units (instead of 'dB')*/
-				switch (name_to_id(scan -> container)) {
-
-					case AV_CONTAINER_ID_MP3:
-						if (!tag_write_mp3(scan, do_album, mode, unit, lowercase, strip, id3v2version))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_FLAC:
-						if (!tag_write_flac(scan, do_album, mode, unit))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_OGG:
-						// must separate because TagLib uses fifferent File classes
-						switch (scan->codec_id) {
-							// Opus needs special handling (different RG tags, -23 LUFS ref.)
-							case AV_CODEC_ID_OPUS:
-								if (!tag_write_ogg_opus(scan, do_album, mode, unit))
-									err_printf("Couldn't write to: %s", scan -> file);
-								break;
-
-							case AV_CODEC_ID_VORBIS:
-								if (!tag_write_ogg_vorbis(scan, do_album, mode, unit))
-									err_printf("Couldn't write to: %s", scan -> file);
-								break;
-
-							case AV_CODEC_ID_FLAC:
-								if (!tag_write_ogg_flac(scan, do_album, mode, unit))
-									err_printf("Couldn't write to: %s", scan -> file);
-								break;
-
-							case AV_CODEC_ID_SPEEX:
-								if (!tag_write_ogg_speex(scan, do_album, mode, unit))
-									err_printf("Couldn't write to: %s", scan -> file);
-								break;
-
-							default:
-								err_printf("Codec 0x%x in %s container not supported",
-									scan->codec_id, scan->container);
-								break;
-						}
-						break;
-
-					case AV_CONTAINER_ID_MP4:
-						if (!tag_write_mp4(scan, do_album, mode, unit, lowercase))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_ASF:
-						if (!tag_write_asf(scan, do_album, mode, unit, lowercase))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_WAV:
-						if (!tag_write_wav(scan, do_album, mode, unit, lowercase, strip, id3v2version))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_AIFF:
-						if (!tag_write_aiff(scan, do_album, mode, unit, lowercase, strip, id3v2version))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_WV:
-						if (!tag_write_wavpack(scan, do_album, mode, unit, lowercase, strip))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					case AV_CONTAINER_ID_APE:
-						if (!tag_write_ape(scan, do_album, mode, unit, lowercase, strip))
-							err_printf("Couldn't write to: %s", scan -> file);
-						break;
-
-					default:
-						err_printf("File type not supported: %s", scan->container);
-						break;
-				}
-				break;
+		default:
+			err_printf("Invalid tag mode");
+			break;
+	}
+}
 
-			case 'a': /* APEv2 tags */
-				err_printf("APEv2 tags are not supported");
-				break;
+static void print_header(const result_opts *opts) {
+	// only once per run, before the first album
+	static bool done = false;
 
-			case 'v': /* Vorbis Comments tags */
-				err_printf("Vorbis Comment tags are not supported");
-				break;
+	if (done)
+		return;
 
-			case 's': /* skip tags */
-				break;
+	done = true;
 
-			case 'r': /* force re-calculation */
-				break;
+	if (opts -> tab_output)
+		printf("File\tMP3 gain\tdB gain\tMax Amplitude\tMax global_gain\tMin global_gain\n");
 
-			default:
-				err_printf("Invalid tag mode");
-				break;
-		}
+	if (opts -> tab_output_new) {
+		printf("File\tLoudness\tRange\tTrue_Peak\tTrue_Peak_dBTP\tReference\tWill_clip\tClip_prevent\tGain\tNew_Peak\tNew_Peak_dBTP");
 
-		if (tab_output) {
-			// output old-style mp3gain-compatible list
-			printf("%s\t", scan -> file);
-			printf("%d\t", 0);
-			printf("%.2f\t", scan -> track_gain);
-			printf("%.6f\t", scan -> track_peak * 32768.0);
-			printf("%d\t", 0);
-			printf("%d\n", 0);
+		// extra columns only for the profile that measures them
+		if (opts -> measures & SCAN_MAXIMA)
+			printf("\tMomentary_Max\tShort_Term_Max");
 
-			if (warn_clip && will_clip)
-				err_printf("The track will clip");
+		printf("\n");
+	}
+}
 
-			if ((i == (nb_files - 1)) && do_album) {
-				printf("%s\t", "Album");
-				printf("%d\t", 0);
-				printf("%.2f\t", scan -> album_gain);
-				printf("%.6f\t", scan -> album_peak * 32768.0);
-				printf("%d\t", 0);
-				printf("%d\n", 0);
-			}
-		} else if (tab_output_new) {
-			// output new style list: File;Loudness;Range;Gain;Reference;Peak;Peak dBTP;Clipping;Clip-prevent
-			printf("%s\t", scan -> file);
-			printf("%.2f LUFS\t", scan -> track_loudness);
-			printf("%.2f %s\t", scan -> track_loudness_range, unit);
-			printf("%.6f\t", scan -> track_peak);
-			printf("%.2f dBTP\t", 20.0 * log10(scan -> track_peak));
-			printf("%.2f LUFS\t", scan -> loudness_reference);
-			printf("%s\t", will_clip ? "Y" : "N");
-			printf("%s\t", tclip ? "Y" : "N");
-			printf("%.2f %s\t", scan -> track_gain, unit);
-			printf("%.6f\t", tnew);
-			printf("%.2f dBTP\n", 20.0 * log10(tnew));
-
-			if ((i == (nb_files - 1)) && do_album) {
-				printf("%s\t", "Album");
-				printf("%.2f LUFS\t", scan -> album_loudness);
-				printf("%.2f %s\t", scan -> album_loudness_range, unit);
-				printf("%.6f\t", scan -> album_peak);
-				printf("%.2f dBTP\t", 20.0 * log10(scan -> album_peak));
-				printf("%.2f LUFS\t", scan -> loudness_reference);
-				printf("%s\t", (!aclip && (again > apeak)) ? "Y" : "N");
-				printf("%s\t", aclip ? "Y" : "N");
-				printf("%.2f %s\t", scan -> album_gain, unit);
-				printf("%.6f\t", anew);
-				printf("%.2f dBTP\n", 20.0 * log10(anew));
-			}
-		} else {
-			// output something human-readable
-			printf("\nTrack: %s\n", scan -> file);
-
-			printf(" Loudness: %8.2f LUFS\n", scan -> track_loudness);
-			printf(" Range:    %8.2f %s\n", scan -> track_loudness_range, unit);
-			printf(" Peak:     %8.6f (%.2f dBTP)\n", scan -> track_peak, 20.0 * log10(scan -> track_peak));
-			if (scan -> codec_id == AV_CODEC_ID_OPUS) {
-				// also show the Q7.8 number that goes into R128_TRACK_GAIN
-				printf(" Gain:     %8.2f %s (%d)%s\n", scan -> track_gain, unit,
-				 gain_to_q78num(scan -> track_gain),
-				 tclip ? " (corrected to prevent clipping)" : "");
-			} else {
-				printf(" Gain:     %8.2f %s%s\n", scan -> track_gain, unit,
-				 tclip ? " (corrected to prevent clipping)" : "");
-			}
+/* Peaks are true peaks unless the analysis profile only has sample peaks. */
+static const char *peak_unit(const scan_result *scan) {
+	return (scan -> measured & SCAN_TRUE_PEAK) ? "dBTP" : "dBFS";
+}
 
-			if (warn_clip && will_clip)
-				err_printf("The track will clip");
+/* One line of the -O list; values that were not measured are "-". */
+static void print_list_new(const result_opts *opts, const scan_result *scan,
+                           const char *name, double loudness, double range,
+                           double peak, bool will_clip, bool clip_prevent,
+                           double gain, double new_peak, double momentary,
+                           double shortterm) {
+	bool peaks = scan -> measured & SCAN_PEAKS;
+
+	printf("%s\t", name);
+	printf("%.2f LUFS\t", loudness);
+
+	if (scan -> measured & SCAN_RANGE)
+		printf("%.2f %s\t", range, opts -> unit);
+	else
+		printf("-\t");
+
+	if (peaks) {
+		printf("%.6f\t", peak);
+		printf("%.2f %s\t", 20.0 * log10(peak), peak_unit(scan));
+	} else {
+		printf("-\t-\t");
+	}
 
-			if ((i == (nb_files - 1)) && do_album) {
-				printf("\nAlbum:\n");
+	printf("%.2f LUFS\t", scan -> loudness_reference);
+	printf("%s\t", peaks ? (will_clip ? "Y" : "N") : "-");
+	printf("%s\t", peaks ? (clip_prevent ? "Y" : "N") : "-");
+	printf("%.2f %s\t", gain, opts -> unit);
 
-				printf(" Loudness: %8.2f LUFS\n", scan -> album_loudness);
-				printf(" Range:    %8.2f %s\n", scan -> album_loudness_range, unit);
-				printf(" Peak:     %8.6f (%.2f dBTP)\n", scan -> album_peak, 20.0 * log10(scan -> album_peak));
-				if (scan -> codec_id == AV_CODEC_ID_OPUS) {
-					// also show the Q7.8 number that goes into R128_ALBUM_GAIN
-					printf(" Gain:     %8.2f %s (%d)%s\n", scan -> album_gain, unit,
-					gain_to_q78num(scan -> album_gain),
-						aclip ? " (corrected to prevent clipping)" : "");
-				} else {
-					printf(" Gain:     %8.2f %s%s\n", scan -> album_gain, unit,
-						aclip ? " (corrected to prevent clipping)" : "");
-				}
-			}
-		}
+	if (peaks) {
+		printf("%.6f\t", new_peak);
+		printf("%.2f %s", 20.0 * log10(new_peak), peak_unit(scan));
+	} else {
+		printf("-\t-");
+	}
+
+	if (opts -> measures & SCAN_MAXIMA)
+		printf("\t%.2f LUFS\t%.2f LUFS", momentary, shortterm);
+
+	printf("\n");
+}
+
+/* The values of a track or album in human-readable form. */
+static void print_values(const result_opts *opts, const scan_result *scan,
+                         double loudness, double range, double peak,
+                         double gain, bool clip_prevent, double momentary,
+                         double shortterm) {
+	printf(" Loudness: %8.2f LUFS\n", loudness);
 
-		free(scan);
+	if (scan -> measured & SCAN_RANGE)
+		printf(" Range:    %8.2f %s\n", range, opts -> unit);
+
+	if (scan -> measured & SCAN_PEAKS)
+		printf(" Peak:     %8.6f (%.2f %s)\n", peak, 20.0 * log10(peak), peak_unit(scan));
+
+	if (scan -> measured & SCAN_MAXIMA) {
+		printf(" Max. M:   %8.2f LUFS\n", momentary);
+		printf(" Max. S:   %8.2f LUFS\n", shortterm);
 	}
 
-	scan_deinit();
+	if (scan -> codec_id == AV_CODEC_ID_OPUS) {
+		// also show the Q7.8 number that goes into R128_*_GAIN
+		printf(" Gain:     %8.2f %s (%d)%s\n", gain, opts -> unit,
+		 gain_to_q78num(gain),
+		 clip_prevent ? " (corrected to prevent clipping)" : "");
+	} else {
+		printf(" Gain:     %8.2f %s%s\n", gain, opts -> unit,
+		 clip_prevent ? " (corrected to prevent clipping)" : "");
+	}
+}
 
-	return 0;
+static void print_result(const result_opts *opts, const track_result *t,
+                         bool last) {
+	const scan_result *scan = t -> scan;
+
+	if (opts -> tab_output) {
+		// output old-style mp3gain-compatible list
+		printf("%s\t", scan -> file);
+		printf("%d\t", 0);
+		printf("%.2f\t", scan -> track_gain);
+		if (scan -> measured & SCAN_PEAKS)
+			printf("%.6f\t", scan -> track_peak * 32768.0);
+		else
+			printf("-\t");
+		printf("%d\t", 0);
+		printf("%d\n", 0);
+
+		if (opts -> warn_clip && t -> will_clip)
+			err_printf("The track will clip");
+
+		if (last && opts -> do_album) {
+			printf("%s\t", "Album");
+			printf("%d\t", 0);
+			printf("%.2f\t", scan -> album_gain);
+			if (scan -> measured & SCAN_PEAKS)
+				printf("%.6f\t", scan -> album_peak * 32768.0);
+			else
+				printf("-\t");
+			printf("%d\t", 0);
+			printf("%d\n", 0);
+		}
+	} else if (opts -> tab_output_new) {
+		// output new style list: File;Loudness;Range;Gain;Reference;Peak;Peak dBTP;Clipping;Clip-prevent
+		print_list_new(opts, scan, scan -> file, scan -> track_loudness,
+		               scan -> track_loudness_range, scan -> track_peak,
+		               t -> will_clip, t -> tclip, scan -> track_gain, t -> tnew,
+		               scan -> track_momentary_max, scan -> track_shortterm_max);
+
+		if (last && opts -> do_album)
+			print_list_new(opts, scan, "Album", scan -> album_loudness,
+			               scan -> album_loudness_range, scan -> album_peak,
+			               !t -> aclip && (t -> again > t -> apeak), t -> aclip,
+			               scan -> album_gain, t -> anew,
+			               scan -> album_momentary_max, scan -> album_shortterm_max);
+	} else {
+		// output something human-readable
+		printf("\nTrack: %s\n", scan -> file);
+
+		print_values(opts, scan, scan -> track_loudness,
+		             scan -> track_loudness_range, scan -> track_peak,
+		             scan -> track_gain, t -> tclip,
+		             scan -> track_momentary_max, scan -> track_shortterm_max);
+
+		if (opts -> warn_clip && t -> will_clip)
+			err_printf("The track will clip");
+
+		if (last && opts -> do_album) {
+			printf("\nAlbum:\n");
+
+			print_values(opts, scan, scan -> album_loudness,
+			             scan -> album_loudness_range, scan -> album_peak,
+			             scan -> album_gain, t -> aclip,
+			             scan -> album_momentary_max, scan -> album_shortterm_max);
+		}
+	}
+}
+
+static void print_stats(const char *file, const scan_stats *stats) {
+	// always to stderr, so it never ends up in -o/-O list output
+	fprintf(stderr, "Stats: %s\n", file);
+	fprintf(stderr, "  Resampler inits: %u\n", stats -> swr_inits);
+	fprintf(stderr, "  Segments:        %u\n", stats -> segments);
+	fprintf(stderr, "  Channel threads: %u\n", stats -> channel_threads);
+	fprintf(stderr, "  Engine:          %s\n", stats -> engine ? stats -> engine : "-");
+	fprintf(stderr, "  Summary size:    %zu bytes\n", stats -> summary_size);
+	fprintf(stderr, "  Oversampled:     %lu of %lu parts\n",
+	        stats -> peak_oversampled, stats -> peak_parts);
+	fprintf(stderr, "  Bytes read:      %llu\n", stats -> bytes_read);
+	fprintf(stderr, "  Probe:           %s\n", stats -> probe ? stats -> probe : "-");
+	fprintf(stderr, "  Input:           %s", stats -> input ? stats -> input : "-");
+	if (stats -> syscalls > 0)
+		fprintf(stderr, ", %lu syscalls", stats -> syscalls);
+	if (stats -> reads > 0)
+		fprintf(stderr, ", %lu reads of %llu bytes on average", stats -> reads,
+		        stats -> read_bytes / stats -> reads);
+	fputc('\n', stderr);
+	fprintf(stderr, "  Decoder:         %s\n", stats -> raw ? "none (raw PCM)" :
+	        stats -> decoder_reused ? "reused" : "new");
+}
+
+/* Stops the prefetcher once all files are scanned. */
+static void prefetch_finish(prefetch *p, const result_opts *opts) {
+	unsigned long long bytes;
+	unsigned nb = prefetch_free(p, &bytes);
+
+	if (opts -> show_stats)
+		fprintf(stderr, "Prefetch: %u files, %llu bytes warmed\n", nb, bytes);
 }
 
 static inline void help(void) {
@@ -716,6 +1376,32 @@ static inline void help(void) {
 	CMD_HELP("--output-new", "-O",  "New format tab-delimited list output");
 	CMD_HELP("--quiet",      "-q",  "Don't print scanning status messages");
 
+	puts("");
+
+	CMD_HELP("--jobs=n",     "-j n", "Scan n files in parallel (0 = one per CPU)");
+	CMD_HELP("--pipeline",   "-P",  "Decode and analyse each file on two threads");
+	CMD_HELP("--segments=n", "-T n", "Analyse long files in n parallel parts (0 = one per CPU)");
+	CMD_HELP("--histogram",  "-H",  "Count loudness blocks in 0.1 LU bins (constant memory)");
+	CMD_HELP("--engine=e",   "-e e", "Loudness engine: auto (default), scalar, sse2, avx2, avx512");
+	CMD_CONT("'-e ebur128' uses libebur128 itself (the reference)");
+	CMD_HELP("--profile=p",  "-p p", "Measure only what profile p needs: gain-only,");
+	CMD_CONT("gain+samplepeak, full (default) or full+momentary");
+	CMD_HELP("--read=n",     "-b n", "Read files in blocks of n KiB (default 1024)");
+	CMD_CONT("'-b mmap' maps them instead, '-b uring' reads ahead with io_uring");
+	CMD_HELP("--nocache",    "-N",  "Leave the page cache as it was before the scan");
+	CMD_HELP("--prefetch=n", "-W n", "Warm up the next files, up to n MiB ahead (0 = off)");
+	CMD_HELP("--disk-order", "-D",  "Scan files in the order they lie on disk");
+	CMD_CONT("results are still reported in the usual order");
+	CMD_HELP("--stats",      "-X",  "Print scanner statistics for each file");
+
+	puts("");
+
+	CMD_HELP("--recursive",    "-R",  "Treat FILES as folders and ReplayGain them recursively");
+	CMD_CONT("Files of the same type in the same folder are one album");
+	CMD_CONT("Albums are tagged with '-a -k -s e' plus the options for their type");
+	CMD_HELP("--exclude=glob", "-E g", "Skip folders matching g (default: '*[[]compilations[]]')");
+	CMD_HELP("--follow-links", "-F",  "Follow symbolic links to folders in recursive mode");
+
 	puts("");
 	// puts("Mandatory arguments to long options are also mandatory for any corresponding short options.");
 	// puts("");
@@ -0,0 +1,442 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <float.h>
+#include <math.h>
+
+#include <ebur128.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define METER_X86 1
+#include <xmmintrin.h>
+#endif
+
+#include "summary.h"
+#include "tap.h"
+#include "meter.h"
+#include "kweight.h"
+#include "truepeak.h"
+#include "printf.h"
+
+// 100 ms steps in the windows that are read back (400 ms and 3 s)
+#define METER_MOMENTARY 4
+#define METER_STEPS     30
+
+struct meter {
+	unsigned              channels;
+	unsigned long         samplerate;
+	int                   flags;
+
+	ebur128_state        *ebur128;      // reference engine, or NULL
+
+	const kweight_kernel *kernel;
+	kweight_coeffs        coeffs;
+	truepeak             *tp;
+
+	size_t                lanes;        // channels rounded up to the kernel
+	size_t                hop;          // frames per 100 ms step
+	size_t                fill;         // frames in the current step
+	unsigned              cur;          // current step in sums
+	unsigned              ring;         // completed steps kept, plus cur
+
+	double               *weights;      // per lane, 0 for unused lanes
+	double               *v;            // filter state, 5 values per lane
+	double               *x;            // one step of converted input
+	double               *sums;         // squared output per step and lane
+	double               *sample_peak;  // per lane, of the last meter_add()
+	double               *true_peak;
+	double               *floor;        // per lane, see meter_set_floor()
+};
+
+static void meter_convert(meter *m, const tap_pcm *pcm, size_t offset,
+                          size_t nb);
+static double meter_window(meter *m, unsigned steps);
+static double meter_weight(int type);
+static int meter_feed(ebur128_state *ebur128, const tap_pcm *pcm,
+                      size_t offset, size_t nb);
+
+/* Whether meter_new() can create a meter with this engine on this CPU. */
+int meter_engine_valid(const char *engine) {
+	return strcmp(engine, "auto") == 0 || strcmp(engine, "ebur128") == 0 ||
+	       kweight_find(engine) != NULL;
+}
+
+/*
+ * Channel position of a channel, as libebur128 assigns them by default
+ * (the LFE and anything beyond 5.1 do not count for loudness).
+ */
+int meter_default_channel(unsigned channels, unsigned ch) {
+	static const int quad[]  = {
+		EBUR128_LEFT, EBUR128_RIGHT,
+		EBUR128_LEFT_SURROUND, EBUR128_RIGHT_SURROUND
+	};
+	static const int five[]  = {
+		EBUR128_LEFT, EBUR128_RIGHT, EBUR128_CENTER,
+		EBUR128_LEFT_SURROUND, EBUR128_RIGHT_SURROUND
+	};
+	static const int other[] = {
+		EBUR128_LEFT, EBUR128_RIGHT, EBUR128_CENTER, EBUR128_UNUSED,
+		EBUR128_LEFT_SURROUND, EBUR128_RIGHT_SURROUND
+	};
+
+	if (channels == 4)
+		return quad[ch];
+
+	if (channels == 5)
+		return five[ch];
+
+	return ch < 6 ? other[ch] : EBUR128_UNUSED;
+}
+
+/* engine NULL means "auto"; flags are METER_* (momentary energy only: 0). */
+meter *meter_new(unsigned channels, unsigned long samplerate,
+                 const char *engine, int flags) {
+	unsigned ch;
+	meter *m;
+
+	m = calloc(1, sizeof(meter));
+	if (m == NULL)
+		fail_printf("OOM");
+
+	m -> channels   = channels;
+	m -> samplerate = samplerate;
+	m -> flags      = flags;
+
+	if (engine != NULL && strcmp(engine, "ebur128") == 0) {
+		// a tap reads the blocks itself, so the state keeps no block lists
+		int mode = EBUR128_MODE_M;
+
+		if (flags & METER_SHORTTERM)
+			mode |= EBUR128_MODE_S;
+
+		if (flags & METER_SAMPLE_PEAK)
+			mode |= EBUR128_MODE_SAMPLE_PEAK;
+
+		if (flags & METER_TRUE_PEAK)
+			mode |= EBUR128_MODE_TRUE_PEAK;
+
+		m -> ebur128 = ebur128_init(channels, samplerate, mode);
+		if (m -> ebur128 == NULL)
+			fail_printf("Could not initialize EBU R128 scanner");
+
+		return m;
+	}
+
+	if (engine != NULL && strcmp(engine, "auto") == 0)
+		engine = NULL;
+
+	// K-weighting vectors hold channels, oversampling vectors hold time
+	if (engine == NULL)
+		m -> kernel = kweight_best(channels);
+	else
+		m -> kernel = kweight_find(engine);
+
+	if (m -> kernel == NULL)
+		fail_printf("Loudness engine '%s' not supported", engine);
+
+	kweight_init(&m -> coeffs, samplerate);
+
+	if (flags & METER_TRUE_PEAK)
+		m -> tp = truepeak_new(channels, samplerate, engine);
+
+	m -> lanes = (channels + m -> kernel -> width - 1) /
+	             m -> kernel -> width * m -> kernel -> width;
+	m -> hop   = (samplerate + 5) / 10;
+	m -> ring  = (flags & METER_SHORTTERM ? METER_STEPS : METER_MOMENTARY) + 1;
+
+	m -> weights     = calloc(m -> lanes, sizeof(double));
+	m -> v           = calloc(5 * m -> lanes, sizeof(double));
+	m -> x           = calloc(m -> hop * m -> lanes, sizeof(double));
+	m -> sums        = calloc(m -> ring * m -> lanes, sizeof(double));
+	m -> sample_peak = calloc(m -> lanes, sizeof(double));
+	m -> true_peak   = calloc(m -> lanes, sizeof(double));
+	m -> floor       = calloc(m -> lanes, sizeof(double));
+	if (m -> weights == NULL || m -> v == NULL || m -> x == NULL ||
+	    m -> sums == NULL || m -> sample_peak == NULL ||
+	    m -> true_peak == NULL || m -> floor == NULL)
+		fail_printf("OOM");
+
+	for (ch = 0; ch < channels; ch++)
+		meter_set_channel(m, ch, meter_default_channel(channels, ch));
+
+	return m;
+}
+
+void meter_free(meter *m) {
+	if (m == NULL)
+		return;
+
+	if (m -> ebur128 != NULL)
+		ebur128_destroy(&m -> ebur128);
+
+	truepeak_free(m -> tp);
+
+	free(m -> weights);
+	free(m -> v);
+	free(m -> x);
+	free(m -> sums);
+	free(m -> sample_peak);
+	free(m -> true_peak);
+	free(m -> floor);
+	free(m);
+}
+
+/* type is one of libebur128's channel positions. */
+void meter_set_channel(meter *m, unsigned ch, int type) {
+	if (m -> ebur128 != NULL)
+		ebur128_set_channel(m -> ebur128, ch, type);
+	else
+		m -> weights[ch] = meter_weight(type);
+}
+
+/* True peaks up to peak need not be found (HUGE_VAL: none at all). */
+void meter_set_floor(meter *m, unsigned ch, double peak) {
+	if (m -> ebur128 == NULL)
+		m -> floor[ch] = peak;
+}
+
+unsigned meter_channels(const meter *m) {
+	return m -> channels;
+}
+
+unsigned long meter_samplerate(const meter *m) {
+	return m -> samplerate;
+}
+
+const char *meter_engine(const meter *m) {
+	return m -> ebur128 != NULL ? "ebur128" : m -> kernel -> name;
+}
+
+int meter_flags(const meter *m) {
+	return m -> flags;
+}
+
+void meter_add(meter *m, const tap_pcm *pcm, size_t offset, size_t nb) {
+	size_t c;
+#ifdef METER_X86
+	unsigned int csr = _mm_getcsr();
+#endif
+
+	if (m -> ebur128 != NULL) {
+		if (meter_feed(m -> ebur128, pcm, offset, nb) != EBUR128_SUCCESS)
+			err_printf("Error filtering");
+
+		return;
+	}
+
+	for (c = 0; c < m -> lanes; c++) {
+		m -> sample_peak[c] = 0.0;
+		m -> true_peak[c]   = 0.0;
+	}
+
+#ifdef METER_X86
+	// like libebur128: decaying filter state must not turn denormal
+	_mm_setcsr(csr | _MM_FLUSH_ZERO_ON);
+#endif
+
+	while (nb > 0) {
+		size_t n = nb < m -> hop - m -> fill ? nb : m -> hop - m -> fill;
+
+		meter_convert(m, pcm, offset, n);
+
+		m -> kernel -> filter(&m -> coeffs, m -> v, m -> x, m -> lanes, n,
+		                      m -> sums + m -> cur * m -> lanes,
+		                      m -> sample_peak);
+		if (m -> tp != NULL)
+			truepeak_add(m -> tp, m -> x, m -> lanes, n, m -> floor,
+			             m -> true_peak);
+
+		m -> fill += n;
+		offset    += n;
+		nb        -= n;
+
+		if (m -> fill == m -> hop) {
+			m -> fill = 0;
+			m -> cur  = (m -> cur + 1) % m -> ring;
+
+			memset(m -> sums + m -> cur * m -> lanes, 0,
+			       sizeof(double) * m -> lanes);
+		}
+	}
+
+	for (c = 0; c < 5 * m -> lanes; c++) {
+		if (fabs(m -> v[c]) < DBL_MIN)
+			m -> v[c] = 0.0;
+	}
+
+#ifdef METER_X86
+	_mm_setcsr(csr);
+#endif
+}
+
+/* Energy of the last 400 ms. */
+double meter_momentary(meter *m) {
+	double loudness;
+
+	if (m -> ebur128 == NULL)
+		return meter_window(m, METER_MOMENTARY);
+
+	ebur128_loudness_momentary(m -> ebur128, &loudness);
+	return summary_energy(loudness);
+}
+
+/* Energy of the last 3 s. */
+double meter_shortterm(meter *m) {
+	double loudness;
+
+	if (!(m -> flags & METER_SHORTTERM))
+		return 0.0;
+
+	if (m -> ebur128 == NULL)
+		return meter_window(m, METER_STEPS);
+
+	ebur128_loudness_shortterm(m -> ebur128, &loudness);
+	return summary_energy(loudness);
+}
+
+void meter_peaks(meter *m, unsigned ch, double *sample_peak,
+                 double *true_peak) {
+	*sample_peak = 0.0;
+	*true_peak   = 0.0;
+
+	if (m -> ebur128 != NULL) {
+		if (m -> flags & METER_SAMPLE_PEAK)
+			ebur128_prev_sample_peak(m -> ebur128, ch, sample_peak);
+
+		if (m -> flags & METER_TRUE_PEAK)
+			ebur128_prev_true_peak(m -> ebur128, ch, true_peak);
+
+		return;
+	}
+
+	// the sample peak comes with the K-weighting at no cost
+	if (m -> flags & METER_SAMPLE_PEAK)
+		*sample_peak = m -> sample_peak[ch];
+
+	if (m -> flags & METER_TRUE_PEAK)
+		*true_peak = fmax(m -> true_peak[ch], m -> sample_peak[ch]);
+}
+
+/* Parts of the input the true-peak detector had, and oversampled. */
+void meter_stats(const meter *m, unsigned long *parts,
+                 unsigned long *oversampled) {
+	*parts       = 0;
+	*oversampled = 0;
+
+	if (m -> tp != NULL)
+		truepeak_stats(m -> tp, parts, oversampled);
+}
+
+// interleave one step (at most) of input into lanes doubles per frame
+#define METER_CONVERT(TYPE, SCALE)                                            \
+	do {                                                                        \
+		size_t i;                                                                 \
+		unsigned ch;                                                              \
+                                                                              \
+		for (i = 0; i < nb; i++) {                                                \
+			const TYPE *in = (const TYPE *) (pcm -> data +                          \
+			                                 (offset + i) * pcm -> stride);         \
+			double *out = m -> x + i * m -> lanes;                                  \
+                                                                              \
+			for (ch = 0; ch < m -> channels; ch++)                                  \
+				out[ch] = (double) in[ch] / (SCALE);                                  \
+		}                                                                         \
+	} while (0)
+
+static void meter_convert(meter *m, const tap_pcm *pcm, size_t offset,
+                          size_t nb) {
+	switch (pcm -> type) {
+		case TAP_S16: METER_CONVERT(int16_t, 32768.0);      break;
+		case TAP_S32: METER_CONVERT(int32_t, 2147483648.0); break;
+		case TAP_DBL: METER_CONVERT(double,  1.0);          break;
+		default:      METER_CONVERT(float,   1.0);          break;
+	}
+}
+
+/* Weighted mean square of the last steps, like libebur128 computes it. */
+static double meter_window(meter *m, unsigned steps) {
+	double energy = 0.0;
+	unsigned s;
+	size_t c;
+
+	for (c = 0; c < m -> lanes; c++) {
+		double sum = 0.0;
+
+		if (m -> weights[c] == 0.0)
+			continue;
+
+		for (s = 1; s <= steps; s++)
+			sum += m -> sums[((m -> cur + m -> ring - s) % m -> ring) *
+			                 m -> lanes + c];
+
+		energy += m -> weights[c] * sum;
+	}
+
+	return energy / (double) (steps * m -> hop);
+}
+
+static double meter_weight(int type) {
+	switch (type) {
+		case EBUR128_UNUSED:
+			return 0.0;
+
+		case EBUR128_LEFT_SURROUND:
+		case EBUR128_RIGHT_SURROUND:
+			return 1.41;
+
+		case EBUR128_DUAL_MONO:
+			return 2.0;
+
+		default:
+			return 1.0;
+	}
+}
+
+static int meter_feed(ebur128_state *ebur128, const tap_pcm *pcm,
+                      size_t offset, size_t nb) {
+	const uint8_t *data = pcm -> data + offset * pcm -> stride;
+
+	switch (pcm -> type) {
+		case TAP_S16:
+			return ebur128_add_frames_short(ebur128, (const short *) data, nb);
+
+		case TAP_S32:
+			return ebur128_add_frames_int(ebur128, (const int *) data, nb);
+
+		case TAP_DBL:
+			return ebur128_add_frames_double(ebur128, (const double *) data, nb);
+
+		default:
+			return ebur128_add_frames_float(ebur128, (const float *) data, nb);
+	}
+}
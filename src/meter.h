@@ -0,0 +1,86 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Loudness meter of a stream: K-weighted block energies plus sample and
+ * true peaks, from libebur128 ("ebur128", the reference) or from the
+ * in-tree engine, whose K-weighting kernel is picked for the CPU and
+ * channel count ("auto") or named ("scalar", "sse2", "avx2", "avx512").
+ *
+ * Block energies are read back right after a 100 ms step was completed
+ * (which is how a tap reads them), and peaks are those of the last call
+ * to meter_add(), like libebur128's "prev" peaks. True peaks that cannot
+ * be above the floor of their channel are not looked for (in-tree engine
+ * only), so a caller that keeps a maximum can let the meter skip most of
+ * the oversampling.
+ *
+ * The momentary energy is always measured; flags add the short-term energy
+ * and the peaks. What is not asked for is neither filtered nor kept, and
+ * reads back as zero.
+ */
+#define METER_SHORTTERM   1
+#define METER_SAMPLE_PEAK 2
+#define METER_TRUE_PEAK   4
+
+#define METER_ALL (METER_SHORTTERM | METER_SAMPLE_PEAK | METER_TRUE_PEAK)
+
+typedef struct meter meter;
+
+int meter_engine_valid(const char *engine);
+int meter_default_channel(unsigned channels, unsigned ch);
+
+meter *meter_new(unsigned channels, unsigned long samplerate,
+                 const char *engine, int flags);
+void meter_free(meter *m);
+
+void meter_set_channel(meter *m, unsigned ch, int type);
+void meter_set_floor(meter *m, unsigned ch, double peak);
+
+unsigned meter_channels(const meter *m);
+unsigned long meter_samplerate(const meter *m);
+const char *meter_engine(const meter *m);
+int meter_flags(const meter *m);
+
+void meter_add(meter *m, const tap_pcm *pcm, size_t offset, size_t nb);
+
+double meter_momentary(meter *m);
+double meter_shortterm(meter *m);
+void meter_peaks(meter *m, unsigned ch, double *sample_peak,
+                 double *true_peak);
+void meter_stats(const meter *m, unsigned long *parts,
+                 unsigned long *oversampled);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,299 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool.h"
+#include "printf.h"
+
+typedef struct {
+	pool_fn          fn;
+	void            *arg;
+} pool_job;
+
+/* A worker's jobs, in a ring buffer that grows as needed. The owner and
+ * thieves alike take jobs from the front (oldest first). */
+typedef struct {
+	pthread_mutex_t  lock;
+	pool_job        *jobs;
+	size_t           head;
+	size_t           size;
+	size_t           alloc;
+} pool_deque;
+
+typedef struct {
+	pool            *p;
+	unsigned         id;
+} pool_worker;
+
+struct pool {
+	pthread_mutex_t  lock;        // for sleeping and waiting only
+	pthread_cond_t   has_job;
+	pthread_cond_t   idle;
+
+	pool_deque      *deques;
+	pool_worker     *workers;
+	unsigned         next;        // deque for the next outside job
+
+	// atomics: submitting and finishing a job only take the lock to wake
+	// a sleeping worker, or pool_wait() after the last job
+	int              nb_queued;   // jobs in the deques, not taken yet
+	unsigned         nb_pending;  // jobs not finished yet
+	unsigned         nb_sleeping; // workers waiting for has_job
+	int              shutdown;
+
+	unsigned         nb_threads;
+	pthread_t       *threads;
+};
+
+// the worker the calling thread is, if it is one
+static __thread pool_worker *pool_self = NULL;
+
+static void *pool_thread(void *data);
+static int pool_take(pool *p, unsigned id, pool_job *job);
+
+static void pool_deque_push(pool_deque *d, pool_fn fn, void *arg);
+static int pool_deque_pop_front(pool_deque *d, pool_job *job);
+
+pool *pool_new(unsigned nb_threads) {
+	unsigned i;
+	pool *p;
+
+	if (nb_threads == 0)
+		nb_threads = 1;
+
+	p = calloc(1, sizeof(pool));
+	if (p == NULL)
+		fail_printf("OOM");
+
+	pthread_mutex_init(&p -> lock, NULL);
+	pthread_cond_init(&p -> has_job, NULL);
+	pthread_cond_init(&p -> idle, NULL);
+
+	p -> deques  = calloc(nb_threads, sizeof(pool_deque));
+	p -> workers = calloc(nb_threads, sizeof(pool_worker));
+	p -> threads = malloc(sizeof(pthread_t) * nb_threads);
+	if (p -> deques == NULL || p -> workers == NULL || p -> threads == NULL)
+		fail_printf("OOM");
+
+	p -> nb_threads = nb_threads;
+
+	for (i = 0; i < nb_threads; i++) {
+		pthread_mutex_init(&p -> deques[i].lock, NULL);
+
+		p -> workers[i].p  = p;
+		p -> workers[i].id = i;
+	}
+
+	for (i = 0; i < nb_threads; i++) {
+		if (pthread_create(&p -> threads[i], NULL, pool_thread, &p -> workers[i]) != 0)
+			fail_printf("Could not create worker thread");
+	}
+
+	return p;
+}
+
+void pool_free(pool *p) {
+	unsigned i;
+
+	if (p == NULL)
+		return;
+
+	pthread_mutex_lock(&p -> lock);
+	p -> shutdown = 1;
+	pthread_cond_broadcast(&p -> has_job);
+	pthread_mutex_unlock(&p -> lock);
+
+	for (i = 0; i < p -> nb_threads; i++)
+		pthread_join(p -> threads[i], NULL);
+
+	for (i = 0; i < p -> nb_threads; i++) {
+		pthread_mutex_destroy(&p -> deques[i].lock);
+		free(p -> deques[i].jobs);
+	}
+
+	pthread_cond_destroy(&p -> idle);
+	pthread_cond_destroy(&p -> has_job);
+	pthread_mutex_destroy(&p -> lock);
+
+	free(p -> threads);
+	free(p -> workers);
+	free(p -> deques);
+	free(p);
+}
+
+void pool_submit(pool *p, pool_fn fn, void *arg) {
+	unsigned id;
+
+	// counted before it is queued, so the count is never too low
+	__atomic_add_fetch(&p -> nb_pending, 1, __ATOMIC_SEQ_CST);
+
+	// a worker keeps its own jobs, everything else is spread evenly
+	if (pool_self != NULL && pool_self -> p == p)
+		id = pool_self -> id;
+	else
+		id = __atomic_fetch_add(&p -> next, 1, __ATOMIC_RELAXED) % p -> nb_threads;
+
+	pool_deque_push(&p -> deques[id], fn, arg);
+	__atomic_add_fetch(&p -> nb_queued, 1, __ATOMIC_SEQ_CST);
+
+	// a worker about to sleep has either seen the job or is counted here
+	if (__atomic_load_n(&p -> nb_sleeping, __ATOMIC_SEQ_CST) > 0) {
+		pthread_mutex_lock(&p -> lock);
+		pthread_cond_signal(&p -> has_job);
+		pthread_mutex_unlock(&p -> lock);
+	}
+}
+
+void pool_wait(pool *p) {
+	pthread_mutex_lock(&p -> lock);
+
+	while (__atomic_load_n(&p -> nb_pending, __ATOMIC_SEQ_CST) > 0)
+		pthread_cond_wait(&p -> idle, &p -> lock);
+
+	pthread_mutex_unlock(&p -> lock);
+}
+
+unsigned pool_nb_cpus(void) {
+	long n = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return n > 0 ? (unsigned) n : 1;
+}
+
+static void *pool_thread(void *data) {
+	pool_worker *self = data;
+	pool *p = self -> p;
+	pool_job job;
+
+	pool_self = self;
+
+	for (;;) {
+		if (pool_take(p, self -> id, &job)) {
+			job.fn(job.arg);
+
+			if (__atomic_sub_fetch(&p -> nb_pending, 1, __ATOMIC_SEQ_CST) == 0) {
+				pthread_mutex_lock(&p -> lock);
+				pthread_cond_broadcast(&p -> idle);
+				pthread_mutex_unlock(&p -> lock);
+			}
+
+			continue;
+		}
+
+		pthread_mutex_lock(&p -> lock);
+		__atomic_add_fetch(&p -> nb_sleeping, 1, __ATOMIC_SEQ_CST);
+
+		while (__atomic_load_n(&p -> nb_queued, __ATOMIC_SEQ_CST) <= 0 &&
+		       !p -> shutdown)
+			pthread_cond_wait(&p -> has_job, &p -> lock);
+
+		__atomic_sub_fetch(&p -> nb_sleeping, 1, __ATOMIC_SEQ_CST);
+
+		if (p -> shutdown &&
+		    __atomic_load_n(&p -> nb_queued, __ATOMIC_SEQ_CST) <= 0) {
+			pthread_mutex_unlock(&p -> lock);
+			break;
+		}
+
+		pthread_mutex_unlock(&p -> lock);
+	}
+
+	return NULL;
+}
+
+/*
+ * Take the oldest job of our own, or else steal the oldest job of another
+ * worker, so jobs start roughly in the order they were submitted (and
+ * albums are opened one after the other, not all at once). Returns
+ * non-zero if a job was found.
+ */
+static int pool_take(pool *p, unsigned id, pool_job *job) {
+	unsigned i;
+
+	if (pool_deque_pop_front(&p -> deques[id], job))
+		goto found;
+
+	for (i = 1; i < p -> nb_threads; i++) {
+		if (pool_deque_pop_front(&p -> deques[(id + i) % p -> nb_threads], job))
+			goto found;
+	}
+
+	return 0;
+
+found:
+	__atomic_sub_fetch(&p -> nb_queued, 1, __ATOMIC_SEQ_CST);
+	return 1;
+}
+
+static void pool_deque_push(pool_deque *d, pool_fn fn, void *arg) {
+	pthread_mutex_lock(&d -> lock);
+
+	if (d -> size == d -> alloc) {
+		size_t i, alloc = d -> alloc ? d -> alloc * 2 : 64;
+		pool_job *jobs = malloc(sizeof(pool_job) * alloc);
+		if (jobs == NULL)
+			fail_printf("OOM");
+
+		// unwrap while copying
+		for (i = 0; i < d -> size; i++)
+			jobs[i] = d -> jobs[(d -> head + i) % d -> alloc];
+
+		free(d -> jobs);
+
+		d -> jobs  = jobs;
+		d -> head  = 0;
+		d -> alloc = alloc;
+	}
+
+	d -> jobs[(d -> head + d -> size) % d -> alloc].fn  = fn;
+	d -> jobs[(d -> head + d -> size) % d -> alloc].arg = arg;
+	d -> size++;
+
+	pthread_mutex_unlock(&d -> lock);
+}
+
+static int pool_deque_pop_front(pool_deque *d, pool_job *job) {
+	int found = 0;
+
+	pthread_mutex_lock(&d -> lock);
+
+	if (d -> size > 0) {
+		*job = d -> jobs[d -> head];
+		d -> head = (d -> head + 1) % d -> alloc;
+		d -> size--;
+		found = 1;
+	}
+
+	pthread_mutex_unlock(&d -> lock);
+
+	return found;
+}
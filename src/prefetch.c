@@ -0,0 +1,279 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "prefetch.h"
+#include "printf.h"
+
+struct prefetch {
+	char * const       *files;
+	unsigned            nb_files;
+	unsigned long long  budget;
+	int                 nocache;    // give warmed pages back once scanned
+	long                page;
+
+	pthread_mutex_t     lock;
+	pthread_cond_t      cond;       // budget given back, or stopping
+	unsigned long long *warm;       // per file, until it has been scanned
+	char               *done;       // scanned, nothing to warm any more
+	unsigned char     **resident;   // per file, with nocache: the pages
+	                                // cached before it was warmed
+	unsigned long long  in_cache;   // warmed and not scanned yet
+	int                 stop;
+
+	unsigned            nb_warmed;
+	unsigned long long  bytes_warmed;
+
+	pthread_t           thread;
+};
+
+static void *prefetch_worker(void *arg);
+static unsigned char *prefetch_resident(int fd, unsigned long long len,
+                                        long page);
+static void prefetch_drop(prefetch *p, unsigned index, int fd,
+                          unsigned char *resident, unsigned long long len);
+
+prefetch *prefetch_new(char * const *files, unsigned nb_files,
+                       unsigned long long budget, int nocache) {
+	prefetch *p = calloc(1, sizeof(prefetch));
+	if (p == NULL)
+		fail_printf("OOM");
+
+	p -> files    = files;
+	p -> nb_files = nb_files;
+	p -> budget   = budget;
+	p -> nocache  = nocache;
+	p -> page     = sysconf(_SC_PAGESIZE);
+
+	p -> warm     = calloc(nb_files ? nb_files : 1, sizeof(unsigned long long));
+	p -> done     = calloc(nb_files ? nb_files : 1, sizeof(char));
+	p -> resident = calloc(nb_files ? nb_files : 1, sizeof(unsigned char *));
+	if (p -> warm == NULL || p -> done == NULL || p -> resident == NULL)
+		fail_printf("OOM");
+
+	pthread_mutex_init(&p -> lock, NULL);
+	pthread_cond_init(&p -> cond, NULL);
+
+	if (pthread_create(&p -> thread, NULL, prefetch_worker, p) != 0)
+		fail_printf("Could not create prefetch thread");
+
+	return p;
+}
+
+/* File index has been scanned: its share of the budget is free again,
+ * and with nocache, what was warmed of it is given back. */
+void prefetch_done(prefetch *p, unsigned index) {
+	unsigned long long len;
+	unsigned char *resident;
+
+	pthread_mutex_lock(&p -> lock);
+
+	len      = p -> warm[index];
+	resident = p -> resident[index];
+
+	p -> done[index]     = 1;
+	p -> in_cache       -= p -> warm[index];
+	p -> warm[index]     = 0;
+	p -> resident[index] = NULL;
+
+	pthread_cond_signal(&p -> cond);
+	pthread_mutex_unlock(&p -> lock);
+
+	if (resident != NULL)
+		prefetch_drop(p, index, -1, resident, len);
+}
+
+/* Stops the thread; returns how many files were warmed, and the bytes. */
+unsigned prefetch_free(prefetch *p, unsigned long long *bytes) {
+	unsigned i, nb_warmed;
+
+	pthread_mutex_lock(&p -> lock);
+	p -> stop = 1;
+	pthread_cond_signal(&p -> cond);
+	pthread_mutex_unlock(&p -> lock);
+
+	pthread_join(p -> thread, NULL);
+
+	// warmed, but not scanned after all
+	for (i = 0; i < p -> nb_files; i++) {
+		if (p -> resident[i] != NULL)
+			prefetch_drop(p, i, -1, p -> resident[i], p -> warm[i]);
+	}
+
+	nb_warmed = p -> nb_warmed;
+	if (bytes != NULL)
+		*bytes = p -> bytes_warmed;
+
+	pthread_cond_destroy(&p -> cond);
+	pthread_mutex_destroy(&p -> lock);
+
+	free(p -> warm);
+	free(p -> done);
+	free(p -> resident);
+	free(p);
+
+	return nb_warmed;
+}
+
+static void *prefetch_worker(void *arg) {
+	prefetch *p = arg;
+	unsigned i;
+
+	pthread_mutex_lock(&p -> lock);
+
+	for (i = 0; i < p -> nb_files && !p -> stop; i++) {
+		unsigned long long len;
+		struct stat st;
+		int fd;
+
+		// the scan got here first
+		if (p -> done[i])
+			continue;
+
+		pthread_mutex_unlock(&p -> lock);
+
+		fd = open(p -> files[i], O_RDONLY | O_CLOEXEC);
+		if (fd >= 0 && (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))) {
+			close(fd);
+			fd = -1;
+		}
+
+		pthread_mutex_lock(&p -> lock);
+
+		if (fd < 0)
+			continue;
+
+		len = st.st_size;
+		if (len > p -> budget)
+			len = p -> budget;
+
+		while (!p -> stop && !p -> done[i] &&
+		       p -> in_cache > 0 && p -> in_cache + len > p -> budget)
+			pthread_cond_wait(&p -> cond, &p -> lock);
+
+		if (!p -> stop && !p -> done[i]) {
+			unsigned char *resident = NULL;
+
+			p -> warm[i]  = len;
+			p -> in_cache += len;
+
+			pthread_mutex_unlock(&p -> lock);
+
+			// what was cached before stays cached (see -N)
+			if (p -> nocache)
+				resident = prefetch_resident(fd, len, p -> page);
+
+			posix_fadvise(fd, 0, len, POSIX_FADV_WILLNEED);
+			pthread_mutex_lock(&p -> lock);
+
+			p -> nb_warmed++;
+			p -> bytes_warmed += len;
+
+			if (resident != NULL && p -> done[i]) {
+				// scanned while it was being warmed
+				pthread_mutex_unlock(&p -> lock);
+				prefetch_drop(p, i, fd, resident, len);
+				pthread_mutex_lock(&p -> lock);
+			} else {
+				p -> resident[i] = resident;
+			}
+		}
+
+		close(fd);
+	}
+
+	pthread_mutex_unlock(&p -> lock);
+
+	return NULL;
+}
+
+/* Which of the first len bytes' pages are in the page cache (mincore()
+ * needs a mapping); NULL if that cannot be told. */
+static unsigned char *prefetch_resident(int fd, unsigned long long len,
+                                        long page) {
+	unsigned char *resident;
+	void *map;
+
+	if (len == 0)
+		return NULL;
+
+	map = mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	resident = malloc((len + page - 1) / page);
+	if (resident == NULL)
+		fail_printf("OOM");
+
+	if (mincore(map, len, resident) < 0) {
+		free(resident);
+		resident = NULL;
+	}
+
+	munmap(map, len);
+
+	return resident;
+}
+
+/* Give back the warmed pages of file index that were not cached before
+ * it was warmed; frees resident. fd < 0: the file is opened again. */
+static void prefetch_drop(prefetch *p, unsigned index, int fd,
+                          unsigned char *resident, unsigned long long len) {
+	unsigned long long i, j, end = (len + p -> page - 1) / p -> page;
+	int own = 0;
+
+	if (fd < 0) {
+		fd  = open(p -> files[index], O_RDONLY | O_CLOEXEC);
+		own = 1;
+	}
+
+	for (i = 0; fd >= 0 && i < end; i = j) {
+		if (resident[i] & 1) {
+			j = i + 1;
+			continue;
+		}
+
+		for (j = i + 1; j < end && !(resident[j] & 1); j++);
+
+		posix_fadvise(fd, i * p -> page, (j - i) * p -> page,
+		              POSIX_FADV_DONTNEED);
+	}
+
+	if (own && fd >= 0)
+		close(fd);
+
+	free(resident);
+}
@@ -51,6 +51,7 @@
 
 int use_syslog = 0;
 int quiet = 0;
+int no_progress = 0;
 
 static void do_log(const char *prefix, const char *fmt, va_list args);
 static void get_screen_size(int fd, unsigned *w, unsigned *h);
@@ -124,7 +125,7 @@ void progress_bar(unsigned ctrl, unsigned long x, unsigned long n, unsigned w) {
 
 	switch (ctrl) {
 		case 0: /* init */
-			if (quiet)
+			if (quiet || no_progress)
 				break;
 
 			if (!isatty(fileno(stream)))
@@ -172,7 +173,7 @@ void progress_bar(unsigned ctrl, unsigned long x, unsigned long n, unsigned w) {
 
 static void do_log(const char *pre, const char *fmt, va_list args) {
 	int rc;
-	static char format[LINE_MAX];
+	char format[LINE_MAX];
 
 	rc = snprintf(format, LINE_MAX, "%s%s\n", use_syslog ? "" : pre, fmt);
 	if (rc < 0) fail_printf("EIO");
@@ -40,6 +40,7 @@ extern "C" {
 
 extern int use_syslog;
 extern int quiet;
+extern int no_progress;
 
 extern void ok_printf(const char *fmt, ...);
 extern void debug_printf(const char *fmt, ...);
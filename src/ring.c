@@ -0,0 +1,140 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <time.h>
+#include <sched.h>
+
+#include "ring.h"
+#include "printf.h"
+
+#define RING_CACHE_LINE 64
+
+struct ring {
+	void   **slots;
+	unsigned mask;
+
+	// producer and consumer positions live on separate cache lines
+	char     pad0[RING_CACHE_LINE];
+	unsigned head;
+	char     pad1[RING_CACHE_LINE];
+	unsigned tail;
+	char     pad2[RING_CACHE_LINE];
+};
+
+static void ring_backoff(unsigned *spins);
+
+ring *ring_new(unsigned size) {
+	unsigned n = 1;
+	ring *r;
+
+	while (n < size)
+		n <<= 1;
+
+	r = calloc(1, sizeof(ring));
+	if (r == NULL)
+		fail_printf("OOM");
+
+	r -> slots = calloc(n, sizeof(void *));
+	if (r -> slots == NULL)
+		fail_printf("OOM");
+
+	r -> mask = n - 1;
+
+	return r;
+}
+
+void ring_free(ring *r) {
+	if (r == NULL)
+		return;
+
+	free(r -> slots);
+	free(r);
+}
+
+int ring_try_push(ring *r, void *item) {
+	unsigned head = __atomic_load_n(&r -> head, __ATOMIC_RELAXED);
+	unsigned tail = __atomic_load_n(&r -> tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail > r -> mask)
+		return 0;
+
+	r -> slots[head & r -> mask] = item;
+	__atomic_store_n(&r -> head, head + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+int ring_try_pop(ring *r, void **item) {
+	unsigned tail = __atomic_load_n(&r -> tail, __ATOMIC_RELAXED);
+	unsigned head = __atomic_load_n(&r -> head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return 0;
+
+	*item = r -> slots[tail & r -> mask];
+	__atomic_store_n(&r -> tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 1;
+}
+
+void ring_push(ring *r, void *item) {
+	unsigned spins = 0;
+
+	while (!ring_try_push(r, item))
+		ring_backoff(&spins);
+}
+
+void *ring_pop(ring *r) {
+	unsigned spins = 0;
+	void *item;
+
+	while (!ring_try_pop(r, &item))
+		ring_backoff(&spins);
+
+	return item;
+}
+
+static void ring_backoff(unsigned *spins) {
+	struct timespec nap = { 0, 50000 };
+
+	if (*spins < 64) {
+		(*spins)++;
+#if defined(__i386__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+#endif
+	} else if (*spins < 128) {
+		(*spins)++;
+		sched_yield();
+	} else {
+		// the other side is busy for a while (e.g. a slow decoder)
+		nanosleep(&nap, NULL);
+	}
+}
@@ -6,7 +6,6 @@
  *
  * 2019-06-30 - Matthias C. Hormann
  *  calculate correct album peak
- *  TODO: This still sucks because albums are handled track-by-track.
  * 2019-08-01 - Matthias C. Hormann
  *  - Move from deprecated libavresample library to libswresample (FFmpeg)
  * 2019-08-16 - Matthias C. Hormann
@@ -37,33 +36,279 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 
+
 #include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <unistd.h>
+#include <pthread.h>
 
-#include <ebur128.h>
 
 #include <libavcodec/avcodec.h>
 #include <libavformat/avformat.h>
 #include <libswresample/swresample.h>
 #include <libavutil/avutil.h>
 #include <libavutil/common.h>
+#include <libavutil/intreadwrite.h>
 #include <libavutil/opt.h>
 
 #include "scan.h"
+#include "ring.h"
+#include "pool.h"
+#include "summary.h"
+#include "tap.h"
+#include "meter.h"
+#include "channels.h"
+#include "input.h"
 #include "printf.h"
 
-static void scan_frame(ebur128_state *ebur128, AVFrame *frame,
-                       SwrContext *swr);
+// decoded frames in flight between decoder and analysis (-P)
+#define SCAN_PIPELINE_DEPTH 32
+
+// segments (-T) are at least this long, in 100 ms steps
+#define SCAN_SEGMENT_MIN    600
+// decoder and filter warm-up before a segment's first block
+#define SCAN_SEGMENT_PREROLL 50
+
+// stream info probing after a fast open (see scan_open_fast())
+#define SCAN_PROBE_SIZE     (256 * 1024)
+#define SCAN_PROBE_DURATION 1000000      // 1 s, in AV_TIME_BASE units
+
+// open decoders every scanning thread keeps for the next files
+#define SCAN_CACHE_DECODERS 4
+
+// sample frames handed to the tap at once by the raw PCM path
+#define SCAN_RAW_FRAMES     65536
+
+/* Demuxers to open a file with, by extension. Only formats whose demuxer
+ * checks a magic number right away: with a wrong extension the open fails
+ * (and the file is probed as usual) instead of misreading the file. MP3
+ * has no such header, so MP2/MP3 files are always probed. */
+static const struct {
+	const char *ext;
+	const char *format;
+} scan_hints[] = {
+	{ ".flac", "flac" },
+	{ ".wav",  "wav"  },
+	{ ".w64",  "w64"  },
+	{ ".aif",  "aiff" },
+	{ ".aiff", "aiff" },
+	{ ".wv",   "wv"   },
+	{ ".ogg",  "ogg"  },
+	{ ".oga",  "ogg"  },
+	{ ".opus", "ogg"  },
+	{ ".spx",  "ogg"  },
+	{ ".ape",  "ape"  },
+	{ ".m4a",  "mp4"  },
+	{ ".mp4",  "mp4"  },
+	{ ".wma",  "asf"  },
+	{ ".asf",  "asf"  },
+};
+
+/* PCM read straight from the file (see scan_raw()): bytes per sample in
+ * the file, and the samples the PCM decoder would have made of it. */
+static const struct {
+	enum AVCodecID id;
+	int            size;
+	int            type;        // TAP_*
+	int            out;         // bytes per output sample
+} scan_raw_codecs[] = {
+	{ AV_CODEC_ID_PCM_S16LE, 2, TAP_S16, 2 },
+	{ AV_CODEC_ID_PCM_S16BE, 2, TAP_S16, 2 },
+	{ AV_CODEC_ID_PCM_S24LE, 3, TAP_S32, 4 },
+	{ AV_CODEC_ID_PCM_S24BE, 3, TAP_S32, 4 },
+	{ AV_CODEC_ID_PCM_S32LE, 4, TAP_S32, 4 },
+	{ AV_CODEC_ID_PCM_S32BE, 4, TAP_S32, 4 },
+	{ AV_CODEC_ID_PCM_F32LE, 4, TAP_FLT, 4 },
+	{ AV_CODEC_ID_PCM_F32BE, 4, TAP_FLT, 4 },
+	{ AV_CODEC_ID_PCM_F64LE, 8, TAP_DBL, 8 },
+	{ AV_CODEC_ID_PCM_F64BE, 8, TAP_DBL, 8 },
+};
+
+#define SCAN_NB_RAW (sizeof(scan_raw_codecs) / sizeof(scan_raw_codecs[0]))
+
+#define SCAN_NB_HINTS (sizeof(scan_hints) / sizeof(scan_hints[0]))
+
+/* Track values, computed as soon as the track's scan is done. */
+typedef struct {
+	double          global;
+	double          range;
+	double          peak;
+	double          momentary;    // loudness of the loudest blocks
+	double          shortterm;
+} scan_track;
+
+/* Analysis profiles: what is measured, from cheapest to everything. */
+typedef struct {
+	const char     *name;
+	int             measures;
+} scan_profile_def;
+
+static const scan_profile_def scan_profiles[] = {
+	{ "gain-only",       0 },
+	{ "gain+samplepeak", SCAN_SAMPLE_PEAK },
+	{ "full",            SCAN_RANGE | SCAN_PEAKS },
+	{ "full+momentary",  SCAN_RANGE | SCAN_PEAKS | SCAN_MAXIMA },
+};
+
+#define SCAN_NB_PROFILES (sizeof(scan_profiles) / sizeof(scan_profiles[0]))
+
+struct scan_ctx {
+	summary        *summaries;
+	scan_track     *tracks;
+	enum AVCodecID *codecs;
+	char          **files;
+	char          **containers;
+	scan_stats     *stats;
+	unsigned        nb_files;
+
+	scan_options    opts;
+
+	/* album values, aggregated once on first use (all scans are done by
+	 * then); every track of the album gets the same ones */
+	int             album_done;
+	int             album_opus;
+	double          album_global;
+	double          album_range;
+	double          album_peak;
+	double          album_momentary;
+	double          album_shortterm;
+};
+
+/* Sample format converter, kept for the whole stream. Formats libebur128
+ * accepts natively are passed straight through (planar ones are only
+ * interleaved); anything else goes through the resampler, which is only
+ * set up again when the decoded frame format changes. The output buffer
+ * only grows. */
+typedef struct {
+	SwrContext *swr;
+	int         in_fmt;
+	int         in_channels;
+	int         in_rate;
+	uint64_t    in_layout;
+
+	uint8_t    *buf;
+	unsigned    buf_size;
+
+	uint8_t    *raw;          // raw PCM as read from the file
+	unsigned    raw_size;
+
+	unsigned    nb_inits;
+} scan_conv;
+
+/* Where decoded frames go. Without a pipeline they are analysed right
+ * away; with one, they are handed to an analysis thread through a ring
+ * and come back through a second ring once analysed, so no frames are
+ * allocated while scanning. */
+typedef struct {
+	tap           *tap;
+	chan_split    *split;       // multichannel: used instead of the tap
+	scan_conv     *conv;
+	AVFrame       *frame;       // the frame the decoder fills next
+
+	int            threaded;
+	ring          *full;        // decoder → analysis
+	ring          *empty;       // analysis → decoder
+	AVFrame      **frames;      // SCAN_PIPELINE_DEPTH of them
+	pthread_t      thread;
+} scan_sink;
+
+/* An open decoder kept for reuse, with the stream parameters it was
+ * opened for and the fields avcodec_open2() set up for them (decoding may
+ * change those). */
+typedef struct {
+	AVCodecContext    *avctx;
+	AVCodecParameters *par;
+	int                busy;        // decoding a file right now
+	unsigned long      used;        // last released, the oldest goes first
+
+	int                sample_rate;
+	int                channels;
+	uint64_t           channel_layout;
+	int                sample_fmt;
+	int                frame_size;
+	int                bits_per_raw_sample;
+} scan_decoder;
+
+/* What a scanning thread keeps from one file to the next: its decoders
+ * (see scan_decoder_open()), the decoded frames, the packet and the sample
+ * format converter. Allocated on the first file a thread scans and freed
+ * when the thread exits. */
+typedef struct {
+	scan_decoder   decoders[SCAN_CACHE_DECODERS];
+	unsigned long  clock;
+
+	AVFrame       *frames[SCAN_PIPELINE_DEPTH];
+	AVPacket      *packet;
+	scan_conv      conv;
+} scan_cache;
+
+/* One part of a long file, analysed on its own thread (-T). */
+typedef struct {
+	const char    *file;
+	int64_t        start;       // first frame recorded
+	int64_t        end;         // end of the recorded part
+	const scan_options *opts;
+	const char    *engine;      // loudness engine asked for
+	const char    *used;        // and the one that was used
+	int            flags;       // what the meter measures (METER_*)
+	summary        sum;
+	unsigned       swr_inits;
+	unsigned long  peak_parts;
+	unsigned long  peak_oversampled;
+	scan_stats     io;          // what was read (see scan_io_stats())
+	int            failed;
+	pthread_t      thread;
+} scan_segment;
+
+static scan_cache *scan_cache_get(void);
+static int scan_decoder_open(scan_cache *cache, AVCodec *codec,
+                             const AVCodecParameters *par,
+                             AVCodecContext **avctx, int *reused);
+static void scan_decoder_close(scan_cache *cache, AVCodecContext **avctx,
+                               int keep);
+
+static int scan_open_input(scan_cache *cache, const scan_options *opts,
+                           const char *file, AVFormatContext **container,
+                           AVCodec **codec, AVCodecContext **avctx,
+                           int *stream_id, const char **probe, int *reused);
+static void scan_close_input(AVFormatContext **container);
+static AVFormatContext *scan_container_new(input *in);
+static const char *scan_open_fast(const char *file, input *in,
+                                  AVFormatContext **container);
+static void scan_io_stats(AVFormatContext *container, scan_stats *stats);
+static meter *scan_new_meter(AVCodecContext *avctx, const char *engine,
+                             int flags);
+static int scan_summary_flags(scan_ctx *ctx);
+static void scan_track_done(scan_ctx *ctx, unsigned index);
+
+static int scan_segmented(scan_ctx *ctx, unsigned index,
+                          AVFormatContext *container, AVCodecContext *avctx,
+                          int stream_id);
+static int scan_raw(scan_ctx *ctx, unsigned index, AVFormatContext *container,
+                    AVCodecContext *avctx, int stream_id, tap *tap,
+                    scan_conv *conv);
+static void *scan_segment_worker(void *arg);
+
+static void scan_sink_open(scan_sink *sink, tap *tap, chan_split *split,
+                           scan_cache *cache, int threaded);
+static void scan_sink_put(scan_sink *sink);
+static void scan_sink_close(scan_sink *sink);
+static void *scan_sink_worker(void *arg);
+
+static void scan_frame(scan_sink *sink, AVFrame *frame);
+static void scan_convert(AVFrame *frame, scan_conv *conv, tap_pcm *pcm);
 static void scan_av_log(void *avcl, int level, const char *fmt, va_list args);
 
-static ebur128_state **scan_states     = NULL;
-static enum AVCodecID *scan_codecs     = NULL;
-static char          **scan_files      = NULL;
-static char          **scan_containers = NULL;
-static int             scan_nb_files   = 0;
+static void scan_album_aggregate(scan_ctx *ctx);
 
 #define LUFS_TO_RG(L) (-18 - L)
 
-int scan_init(unsigned nb_files) {
+scan_ctx *scan_init(unsigned nb_files) {
+	scan_ctx *ctx;
+
   /*
 	 * av_register_all() got deprecated in lavf 58.9.100
 	 * It is now useless
@@ -74,143 +319,275 @@ int scan_init(unsigned nb_files) {
 
 	av_log_set_callback(scan_av_log);
 
-	scan_nb_files = nb_files;
+	ctx = calloc(1, sizeof(scan_ctx));
+	if (ctx == NULL)
+		fail_printf("OOM");
+
+	ctx -> nb_files = nb_files;
 
-	scan_states = malloc(sizeof(ebur128_state *) * scan_nb_files);
-	if (scan_states == NULL)
+	ctx -> summaries = calloc(nb_files, sizeof(summary));
+	if (ctx -> summaries == NULL)
 		fail_printf("OOM");
 
-	scan_files = malloc(sizeof(char *) * scan_nb_files);
-	if (scan_files == NULL)
+	ctx -> tracks = calloc(nb_files, sizeof(scan_track));
+	if (ctx -> tracks == NULL)
 		fail_printf("OOM");
 
-  scan_containers = malloc(sizeof(char *) * scan_nb_files);
-	if (scan_containers == NULL)
+	ctx -> files = calloc(nb_files, sizeof(char *));
+	if (ctx -> files == NULL)
 		fail_printf("OOM");
 
-	scan_codecs = malloc(sizeof(enum AVCodecID) * scan_nb_files);
-	if (scan_codecs == NULL)
+	ctx -> containers = calloc(nb_files, sizeof(char *));
+	if (ctx -> containers == NULL)
 		fail_printf("OOM");
 
-	return 0;
+	ctx -> codecs = calloc(nb_files, sizeof(enum AVCodecID));
+	if (ctx -> codecs == NULL)
+		fail_printf("OOM");
+
+	ctx -> stats = calloc(nb_files, sizeof(scan_stats));
+	if (ctx -> stats == NULL)
+		fail_printf("OOM");
+
+	return ctx;
 }
 
-void scan_deinit() {
-	int i;
+void scan_deinit(scan_ctx *ctx) {
+	unsigned i;
+
+	if (ctx == NULL)
+		return;
 
-	for (i = 0; i < scan_nb_files; i++) {
-		ebur128_destroy(&scan_states[i]);
-		free(scan_files[i]);
-    free(scan_containers[i]);
+	for (i = 0; i < ctx -> nb_files; i++) {
+		summary_free(&ctx -> summaries[i]);
+		free(ctx -> files[i]);
+		free(ctx -> containers[i]);
 	}
 
-	free(scan_states);
+	free(ctx -> summaries);
+	free(ctx -> tracks);
+	free(ctx -> files);
+	free(ctx -> containers);
+	free(ctx -> codecs);
+	free(ctx -> stats);
+	free(ctx);
 }
 
-int scan_file(const char *file, unsigned index) {
-	int rc, stream_id = -1;
-	double start = 0, len = 0;
-  char infotext[20];
-  char infobuf[512];
+void scan_set_options(scan_ctx *ctx, const scan_options *opts) {
+	ctx -> opts = *opts;
+}
 
-	AVFormatContext *container = NULL;
+/* "auto", "ebur128", or a K-weighting kernel this CPU can run. */
+int scan_engine_valid(const char *engine) {
+	return meter_engine_valid(engine);
+}
 
-	AVCodec *codec;
-	AVCodecContext *ctx;
+/* SCAN_* flags of a profile (NULL: "full"), or -1 if there is none. */
+int scan_profile(const char *profile) {
+	size_t i;
 
-	AVFrame *frame;
-	AVPacket packet;
+	if (profile == NULL)
+		profile = "full";
 
-	SwrContext *swr;
+	for (i = 0; i < SCAN_NB_PROFILES; i++) {
+		if (strcmp(scan_profiles[i].name, profile) == 0)
+			return scan_profiles[i].measures;
+	}
+
+	return -1;
+}
 
-	ebur128_state **ebur128 = &scan_states[index];
+static int scan_measures(scan_ctx *ctx) {
+	int measures = scan_profile(ctx -> opts.profile);
 
-	int buffer_size = 192000 + AV_INPUT_BUFFER_PADDING_SIZE;
+	return measures < 0 ? scan_profile(NULL) : measures;
+}
 
-	uint8_t buffer[buffer_size];
+/* What the meters of a scan have to measure for its profile. */
+static int scan_meter_flags(scan_ctx *ctx) {
+	int measures = scan_measures(ctx), flags = 0;
 
-	if (index >= scan_nb_files) {
-		err_printf("Index too high");
-		return -1;
-	}
+	if (measures & (SCAN_RANGE | SCAN_MAXIMA))
+		flags |= METER_SHORTTERM;
 
-	scan_files[index] = strdup(file);
+	if (measures & SCAN_SAMPLE_PEAK)
+		flags |= METER_SAMPLE_PEAK;
 
-	rc = avformat_open_input(&container, file, NULL, NULL);
-	if (rc < 0) {
-		char errbuf[2048];
-		av_strerror(rc, errbuf, 2048);
+	if (measures & SCAN_TRUE_PEAK)
+		flags |= METER_TRUE_PEAK;
+
+	return flags;
+}
+
+static int scan_summary_flags(scan_ctx *ctx) {
+	return ctx -> opts.histogram ? SUMMARY_HISTOGRAM : 0;
+}
+
+/* Tracks that could not be opened (with keep_going) have no summary. */
+static int scan_has_result(scan_ctx *ctx, unsigned index) {
+	return ctx -> summaries[index].channels > 0;
+}
 
-		fail_printf("Could not open input: %s", errbuf);
+static unsigned scan_first_result(scan_ctx *ctx) {
+	unsigned i;
+
+	for (i = 0; i < ctx -> nb_files; i++) {
+		if (scan_has_result(ctx, i))
+			break;
 	}
-  scan_containers[index] = strdup(container->iformat->name);
-  ok_printf("Container: %s [%s]", container->iformat->long_name, container->iformat->name);
 
-	rc = avformat_find_stream_info(container, NULL);
-	if (rc < 0) {
-		char errbuf[2048];
-		av_strerror(rc, errbuf, 2048);
+	return i;
+}
+
+/* One pass over the album's summaries, shared by all of its tracks. */
+static void scan_album_aggregate(scan_ctx *ctx) {
+	unsigned i, nb = 0;
+	summary **sums;
+
+	if (ctx -> album_done)
+		return;
+
+	sums = malloc(sizeof(summary *) * (ctx -> nb_files + 1));
+	if (sums == NULL)
+		fail_printf("OOM");
+
+	ctx -> album_peak      = 0.0;
+	ctx -> album_momentary = -HUGE_VAL;
+	ctx -> album_shortterm = -HUGE_VAL;
+	ctx -> album_opus      = 0;
+
+	for (i = 0; i < ctx -> nb_files; i++) {
+		if (!scan_has_result(ctx, i))
+			continue;
 
-		fail_printf("Could not find stream info: %s", errbuf);
+		sums[nb++] = &ctx -> summaries[i];
+
+		ctx -> album_peak = FFMAX(ctx -> album_peak,
+		                          summary_peak(&ctx -> summaries[i]));
+
+		ctx -> album_momentary = FFMAX(ctx -> album_momentary,
+		                               ctx -> tracks[i].momentary);
+		ctx -> album_shortterm = FFMAX(ctx -> album_shortterm,
+		                               ctx -> tracks[i].shortterm);
+
+		if (ctx -> codecs[i] == AV_CODEC_ID_OPUS)
+			ctx -> album_opus = 1;
 	}
 
-  /* select the audio stream */
-  stream_id = av_find_best_stream(container, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0);
+	summary_loudness_global(sums, nb, &ctx -> album_global);
+	summary_loudness_range(sums, nb, &ctx -> album_range);
 
-	if (stream_id < 0)
-		fail_printf("Could not find audio stream");
+	free(sums);
 
-  /* create decoding context */
-  ctx = avcodec_alloc_context3(codec);
-  if (!ctx)
-    fail_printf("Could not allocate audio codec context!");
+	ctx -> album_done = 1;
+}
 
-  avcodec_parameters_to_context(ctx, container->streams[stream_id]->codecpar);
+int scan_file(scan_ctx *ctx, const char *file, unsigned index) {
+	int rc, stream_id = -1, failed = 0;
+	double start = 0, len = 0;
+  char infotext[20];
+  char infobuf[512];
 
-  /* init the audio decoder */
-	rc = avcodec_open2(ctx, codec, NULL);
-	if (rc < 0) {
-		char errbuf[2048];
-		av_strerror(rc, errbuf, 2048);
+	AVFormatContext *container = NULL;
 
-		fail_printf("Could not open codec: %s", errbuf);
+	AVCodec *codec;
+	AVCodecContext *avctx;
+
+	scan_cache *cache = scan_cache_get();
+	AVPacket   *packet = cache -> packet;
+
+	scan_sink   sink;
+	tap         tap;
+	chan_split *split = NULL;
+
+	meter *meter = NULL;
+
+	if (index >= ctx -> nb_files) {
+		err_printf("Index too high");
+		return -1;
 	}
 
-  // try to get default channel layout (they aren’t specified in .wav files)
-  if (!ctx->channel_layout)
-    ctx->channel_layout = av_get_default_channel_layout(ctx->channels);
+	ctx -> files[index] = strdup(file);
+
+	if (scan_open_input(cache, &ctx -> opts, file, &container, &codec, &avctx,
+	                    &stream_id, &ctx -> stats[index].probe,
+	                    &ctx -> stats[index].decoder_reused) < 0) {
+		if (!ctx -> opts.keep_going)
+			_exit(EXIT_FAILURE);
+
+		// no summary: the track has no result and is left out of the album
+		err_printf("Skipping '%s'", file);
+		return -1;
+	}
+
+  ctx -> containers[index] = strdup(container->iformat->name);
+  ok_printf("Container: %s [%s]", container->iformat->long_name, container->iformat->name);
 
   // show some information about the file
   // only show bits/sample where it makes sense
   infotext[0] = '\0';
-  if (ctx->bits_per_raw_sample > 0 || ctx->bits_per_coded_sample > 0) {
+  if (avctx->bits_per_raw_sample > 0 || avctx->bits_per_coded_sample > 0) {
     snprintf(infotext, sizeof(infotext), "%d bit, ",
-      ctx->bits_per_raw_sample > 0 ? ctx->bits_per_raw_sample : ctx->bits_per_coded_sample);
+      avctx->bits_per_raw_sample > 0 ? avctx->bits_per_raw_sample : avctx->bits_per_coded_sample);
   }
-  av_get_channel_layout_string(infobuf, sizeof(infobuf), -1, ctx->channel_layout);
+  av_get_channel_layout_string(infobuf, sizeof(infobuf), -1, avctx->channel_layout);
   ok_printf("Stream #%d: %s, %s%d Hz, %d ch, %s",
-    stream_id, codec->long_name, infotext, ctx->sample_rate, ctx->channels, infobuf);
+    stream_id, codec->long_name, infotext, avctx->sample_rate, avctx->channels, infobuf);
 
-	scan_codecs[index] = codec -> id;
+	ctx -> codecs[index] = codec -> id;
 
-	av_init_packet(&packet);
+	if (ctx -> opts.segments > 1 &&
+	    scan_segmented(ctx, index, container, avctx, stream_id) == 0) {
+		scan_io_stats(container, &ctx -> stats[index]);
+		scan_track_done(ctx, index);
+		scan_decoder_close(cache, &avctx, 1);
+		scan_close_input(&container);
+		return 0;
+	}
 
-	packet.data = buffer;
-	packet.size = buffer_size;
+	// not split in time: record the whole track
+	summary_init(&ctx -> summaries[index], avctx -> channels,
+	             scan_summary_flags(ctx));
+
+	if (avctx -> channels > 2 && chan_split_supported(avctx -> sample_fmt)) {
+		// the other files scanned at once (-j) have their share of CPUs
+		unsigned threads = pool_nb_cpus() / FFMAX(ctx -> opts.jobs, 1);
+
+		split = chan_split_new(avctx -> channels, avctx -> sample_rate,
+		                       ctx -> opts.engine, scan_meter_flags(ctx),
+		                       &ctx -> summaries[index], FFMAX(threads, 1));
+		ctx -> stats[index].engine = chan_split_engine(split);
+	} else {
+		meter = scan_new_meter(avctx, ctx -> opts.engine,
+		                       scan_meter_flags(ctx));
+		tap_init(&tap, meter, &ctx -> summaries[index], 0, 0, INT64_MAX);
+		ctx -> stats[index].engine = meter_engine(meter);
+	}
 
-	swr = swr_alloc();
+	cache -> conv.nb_inits = 0;
 
-	*ebur128 = ebur128_init(
-		ctx -> channels, ctx -> sample_rate,
-		EBUR128_MODE_S | EBUR128_MODE_I | EBUR128_MODE_LRA |
-		EBUR128_MODE_SAMPLE_PEAK | EBUR128_MODE_TRUE_PEAK
-	);
-	if (*ebur128 == NULL)
-		fail_printf("Could not initialize EBU R128 scanner");
+	if (split == NULL) {
+		rc = scan_raw(ctx, index, container, avctx, stream_id, &tap,
+		              &cache -> conv);
+		if (rc == 0)
+			goto analysed;
 
-	frame = av_frame_alloc();
-	if (frame == NULL)
-		fail_printf("OOM");
+		// a read error fails the scan, like a file that cannot be opened
+		if (rc > 0) {
+			meter_free(meter);
+			summary_free(&ctx -> summaries[index]);
+			scan_decoder_close(cache, &avctx, 1);
+			scan_close_input(&container);
+
+			if (!ctx -> opts.keep_going)
+				_exit(EXIT_FAILURE);
+
+			err_printf("Skipping '%s'", file);
+			return -1;
+		}
+	}
+
+	scan_sink_open(&sink, &tap, split, cache, ctx -> opts.pipeline);
 
 	if (container -> streams[stream_id] -> start_time != AV_NOPTS_VALUE)
 		start = container -> streams[stream_id] -> start_time *
@@ -222,37 +599,41 @@ int scan_file(const char *file, unsigned index) {
 
 	progress_bar(0, 0, 0, 0);
 
-	while (av_read_frame(container, &packet) >= 0) {
-		if (packet.stream_index == stream_id) {
+	while (av_read_frame(container, packet) >= 0) {
+		if (packet -> stream_index == stream_id) {
 
-      rc = avcodec_send_packet(ctx, &packet);
+      rc = avcodec_send_packet(avctx, packet);
       if (rc < 0) {
         err_printf("Error while sending a packet to the decoder");
+        av_packet_unref(packet);
+        failed = 1;
         break;
       }
 
       while (rc >= 0) {
-        rc = avcodec_receive_frame(ctx, frame);
+        rc = avcodec_receive_frame(avctx, sink.frame);
         if (rc == AVERROR(EAGAIN) || rc == AVERROR_EOF) {
             break;
         } else if (rc < 0) {
             err_printf("Error while receiving a frame from the decoder");
+            av_packet_unref(packet);
+            failed = 1;
             goto end;
         }
         if (rc >= 0) {
-          double pos = frame -> pkt_dts *
+          double pos = sink.frame -> pkt_dts *
   				             av_q2d(container -> streams[stream_id] -> time_base);
-  				scan_frame(*ebur128, frame, swr);
+  				scan_sink_put(&sink);
 
           if (pos >= 0)
             progress_bar(1, pos - start, len, 0);
         }
       }
 
-      av_frame_unref(frame);
+      av_frame_unref(sink.frame);
     }
 
-		av_packet_unref(&packet);
+		av_packet_unref(packet);
 	}
 
   // complete progress bar for very short files (only cosmetic)
@@ -261,199 +642,1263 @@ int scan_file(const char *file, unsigned index) {
 end:
 	progress_bar(2, 0, 0, 0);
 
-	av_frame_free(&frame);
+	// waits for the analysis thread, if any
+	scan_sink_close(&sink);
+
+	ctx -> stats[index].swr_inits += cache -> conv.nb_inits;
+
+analysed:
+	scan_io_stats(container, &ctx -> stats[index]);
 
-	swr_free(&swr);
+	// everything needed later is in the summary now
+	if (split != NULL) {
+		ctx -> stats[index].channel_threads = chan_split_free(split,
+			&ctx -> stats[index].peak_parts,
+			&ctx -> stats[index].peak_oversampled);
+	} else {
+		meter_stats(meter, &ctx -> stats[index].peak_parts,
+		            &ctx -> stats[index].peak_oversampled);
+		meter_free(meter);
+	}
+
+	scan_track_done(ctx, index);
 
-	avcodec_close(ctx);
+	// a decoder that failed is not trusted with the next file
+	scan_decoder_close(cache, &avctx, !failed);
 
-	avformat_close_input(&container);
+	scan_close_input(&container);
 
 	return 0;
 }
 
-scan_result *scan_get_track_result(unsigned index, double pre_gain) {
-	unsigned ch;
-
-	double global, range, peak = 0.0;
+/*
+ * Computes the track values right away (on the scanning thread) and trims
+ * the summary to what the album values still need: nothing but the peaks
+ * if there is no album.
+ */
+static void scan_track_done(scan_ctx *ctx, unsigned index) {
+	summary *sum = &ctx -> summaries[index];
+	scan_track *track = &ctx -> tracks[index];
+
+	summary_loudness_global(&sum, 1, &track -> global);
+	summary_loudness_range(&sum, 1, &track -> range);
+	track -> peak      = summary_peak(sum);
+	track -> momentary = summary_loudness(sum -> gating.max);
+	track -> shortterm = summary_loudness(sum -> shortterm.max);
+
+	if (ctx -> opts.track_only)
+		summary_drop_blocks(sum);
+	else
+		summary_shrink(sum);
+
+	ctx -> stats[index].summary_size = summary_size(sum);
+}
 
+scan_result *scan_get_track_result(scan_ctx *ctx, unsigned index, double pre_gain) {
 	scan_result *result = NULL;
-	ebur128_state *ebur128 = NULL;
+	scan_track *track;
 
-	if (index >= scan_nb_files) {
+	if (index >= ctx -> nb_files) {
 		err_printf("Index too high");
 		return NULL;
 	}
 
+	// skipped (keep_going), nothing to report
+	if (!scan_has_result(ctx, index))
+		return NULL;
+
 	result = malloc(sizeof(scan_result));
 	if (result == NULL)
 		fail_printf("OOM");
 
-	ebur128 = scan_states[index];
-
-	if (ebur128_loudness_global(ebur128, &global) != EBUR128_SUCCESS)
-		global = 0.0;
-
-	if (ebur128_loudness_range(ebur128, &range) != EBUR128_SUCCESS)
-		range = 0.0;
-
-	for (ch = 0; ch < ebur128 -> channels; ch++) {
-		double tmp;
-
-		if (ebur128_true_peak(ebur128, ch, &tmp) != EBUR128_SUCCESS)
-			continue;
-
-		peak = FFMAX(peak, tmp);
-	}
+	track = &ctx -> tracks[index];
 
   // Opus is always based on -23 LUFS, we have to adapt
-  if (scan_codecs[index] == AV_CODEC_ID_OPUS)
+  if (ctx -> codecs[index] == AV_CODEC_ID_OPUS)
     pre_gain = pre_gain - 5.0f;
 
-	result -> file                 = scan_files[index];
-  result -> container            = scan_containers[index];
-	result -> codec_id             = scan_codecs[index];
+	result -> file                 = ctx -> files[index];
+  result -> container            = ctx -> containers[index];
+	result -> codec_id             = ctx -> codecs[index];
+	result -> measured             = scan_measures(ctx);
 
-	result -> track_gain           = LUFS_TO_RG(global) + pre_gain;
-	result -> track_peak           = peak;
-	result -> track_loudness       = global;
-	result -> track_loudness_range = range;
+	result -> track_gain           = LUFS_TO_RG(track -> global) + pre_gain;
+	result -> track_peak           = track -> peak;
+	result -> track_loudness       = track -> global;
+	result -> track_loudness_range = track -> range;
+	result -> track_momentary_max  = track -> momentary;
+	result -> track_shortterm_max  = track -> shortterm;
 
 	result -> album_gain           = 0.f;
 	result -> album_peak           = 0.f;
 	result -> album_loudness       = 0.f;
 	result -> album_loudness_range = 0.f;
+	result -> album_momentary_max  = 0.f;
+	result -> album_shortterm_max  = 0.f;
 
   result -> loudness_reference   = LUFS_TO_RG(-pre_gain);
 
 	return result;
 }
 
-int scan_album_has_different_containers() {
-  int i;
-  for (i = 0; i < scan_nb_files; i++) {
-    if (strcmp(scan_containers[0], scan_containers[i]))
+int scan_album_has_different_containers(scan_ctx *ctx) {
+  unsigned i, first = scan_first_result(ctx);
+  for (i = first; i < ctx -> nb_files; i++) {
+    if (scan_has_result(ctx, i) && strcmp(ctx -> containers[first], ctx -> containers[i]))
       return 1; // true
   }
   return 0; // false
 }
 
-int scan_album_has_different_codecs() {
-  int i;
-  for (i = 0; i < scan_nb_files; i++) {
-    if (scan_codecs[0] != scan_codecs[i])
+int scan_album_has_different_codecs(scan_ctx *ctx) {
+  unsigned i, first = scan_first_result(ctx);
+  for (i = first; i < ctx -> nb_files; i++) {
+    if (scan_has_result(ctx, i) && ctx -> codecs[first] != ctx -> codecs[i])
       return 1; // true
   }
   return 0; // false
 }
 
-int scan_album_has_opus() {
-  int i;
-  for (i = 0; i < scan_nb_files; i++) {
-    if (scan_codecs[i] == AV_CODEC_ID_OPUS)
+int scan_album_has_opus(scan_ctx *ctx) {
+  unsigned i;
+  for (i = 0; i < ctx -> nb_files; i++) {
+    if (scan_has_result(ctx, i) && ctx -> codecs[i] == AV_CODEC_ID_OPUS)
       return 1;
   }
   return 0;
 }
 
-double scan_get_album_peak() {
-  double peak = 0.0;
-  int i;
-  unsigned ch;
-  ebur128_state *ebur128 = NULL;
-
-  for (i = 0; i < scan_nb_files; i++) {
-    ebur128 = scan_states[i];
-
-    for (ch = 0; ch < ebur128 -> channels; ch++) {
-  		double tmp;
-
-  		if (ebur128_true_peak(ebur128, ch, &tmp) != EBUR128_SUCCESS)
-  			continue;
-
-  		peak = FFMAX(peak, tmp);
-  	}
-  }
-  return peak;
+double scan_get_album_peak(scan_ctx *ctx) {
+  scan_album_aggregate(ctx);
+  return ctx -> album_peak;
 }
 
-void scan_set_album_result(scan_result *result, double pre_gain) {
-	double global, range;
-
-	if (ebur128_loudness_global_multiple(
-		scan_states, scan_nb_files, &global
-	) != EBUR128_SUCCESS)
-		global = 0.0;
-
-	if (ebur128_loudness_range_multiple(
-		scan_states, scan_nb_files, &range
-	) != EBUR128_SUCCESS)
-		range = 0.0;
+void scan_set_album_result(scan_ctx *ctx, scan_result *result, double pre_gain) {
+	scan_album_aggregate(ctx);
 
   // Opus is always based on -23 LUFS, we have to adapt
   // When we arrive here, it’s already verified that the album
   // does NOT mix Opus and non-Opus tracks,
   // so we can safely reduce the pre-gain to arrive at -23 LUFS.
-  if (scan_album_has_opus())
+  if (ctx -> album_opus)
     pre_gain = pre_gain - 5.0f;
 
-	result -> album_gain           = LUFS_TO_RG(global) + pre_gain;
+	result -> album_gain           = LUFS_TO_RG(ctx -> album_global) + pre_gain;
 	// Calculate correct album peak (v0.2.1)
-	result -> album_peak           = scan_get_album_peak();
-	result -> album_loudness       = global;
-	result -> album_loudness_range = range;
+	result -> album_peak           = ctx -> album_peak;
+	result -> album_loudness       = ctx -> album_global;
+	result -> album_loudness_range = ctx -> album_range;
+	result -> album_momentary_max  = ctx -> album_momentary;
+	result -> album_shortterm_max  = ctx -> album_shortterm;
 }
 
-static void scan_frame(ebur128_state *ebur128, AVFrame *frame,
-                       SwrContext *swr) {
-	int rc;
+const scan_stats *scan_get_stats(scan_ctx *ctx, unsigned index) {
+	if (index >= ctx -> nb_files) {
+		err_printf("Index too high");
+		return NULL;
+	}
 
-	uint8_t            *out_data;
-	size_t              out_size;
-	int                 out_linesize;
-	enum AVSampleFormat out_fmt = AV_SAMPLE_FMT_S16;
+	return &ctx -> stats[index];
+}
+
+/*
+ * Open a file and its decoder. Errors are reported here; the caller only
+ * decides whether to go on without the file. probe tells how the file was
+ * opened: "header" or "hint" (see scan_open_fast()), or "full"; reused
+ * whether the decoder was kept from an earlier file. The decoder goes back
+ * with scan_decoder_close().
+ */
+static int scan_open_input(scan_cache *cache, const scan_options *opts,
+                           const char *file, AVFormatContext **container,
+                           AVCodec **codec, AVCodecContext **avctx,
+                           int *stream_id, const char **probe, int *reused) {
+	int rc;
+	unsigned i;
+	char errbuf[2048];
+	input *in;
+
+	in = input_open(file, opts -> read_mode == SCAN_READ_MMAP  ? INPUT_MMAP :
+	                      opts -> read_mode == SCAN_READ_URING ? INPUT_URING :
+	                                                             INPUT_READ,
+	                opts -> read_size, opts -> no_cache ? INPUT_NOCACHE : 0);
+
+	*probe = scan_open_fast(file, in, container);
+
+	if (*probe == NULL) {
+		*probe = "full";
+
+		// back to the start after a failed fast open
+		if (in != NULL) {
+			avio_seek(input_avio(in), 0, SEEK_SET);
+			*container = scan_container_new(in);
+		}
+
+		rc = avformat_open_input(container, file, NULL, NULL);
+		if (rc < 0) {
+			av_strerror(rc, errbuf, 2048);
+
+			err_printf("Could not open input: %s", errbuf);
+			input_close(in);
+			return -1;
+		}
+
+		rc = avformat_find_stream_info(*container, NULL);
+		if (rc < 0) {
+			av_strerror(rc, errbuf, 2048);
+
+			err_printf("Could not find stream info: %s", errbuf);
+			goto fail;
+		}
+	}
 
-	av_opt_set_channel_layout(swr, "in_channel_layout", frame -> channel_layout, 0);
-	av_opt_set_channel_layout(swr, "out_channel_layout", frame -> channel_layout, 0);
+  /* select the audio stream */
+  *stream_id = av_find_best_stream(*container, AVMEDIA_TYPE_AUDIO, -1, -1, codec, 0);
 
-  // add channel count to properly handle .wav reading
-  av_opt_set_int(swr, "in_channel_count",  frame -> channels, 0);
-  av_opt_set_int(swr, "out_channel_count", frame -> channels, 0);
+	if (*stream_id < 0) {
+		err_printf("Could not find audio stream");
+		goto fail;
+	}
 
-  av_opt_set_int(swr, "in_sample_rate", frame -> sample_rate, 0);
-  av_opt_set_int(swr, "out_sample_rate", frame -> sample_rate, 0);
-	av_opt_set_sample_fmt(swr, "in_sample_fmt", frame -> format, 0);
-	av_opt_set_sample_fmt(swr, "out_sample_fmt", out_fmt, 0);
+	// video, cover art and subtitles are not even read from now on
+	for (i = 0; i < (*container) -> nb_streams; i++) {
+		if ((int) i != *stream_id)
+			(*container) -> streams[i] -> discard = AVDISCARD_ALL;
+	}
 
-	rc = swr_init(swr);
+  /* get a decoder, opened for these parameters */
+	rc = scan_decoder_open(cache, *codec,
+	                       (*container) -> streams[*stream_id] -> codecpar,
+	                       avctx, reused);
 	if (rc < 0) {
-		char errbuf[2048];
 		av_strerror(rc, errbuf, 2048);
 
-		fail_printf("Could not open SWResample: %s", errbuf);
+		err_printf("Could not open codec: %s", errbuf);
+		goto fail;
+	}
+
+  // try to get default channel layout (they aren’t specified in .wav files)
+  if (!(*avctx)->channel_layout)
+    (*avctx)->channel_layout = av_get_default_channel_layout((*avctx)->channels);
+
+	return 0;
+
+fail:
+	scan_close_input(container);
+	return -1;
+}
+
+/* Close a file opened by scan_open_input(), and its input if it has one. */
+static void scan_close_input(AVFormatContext **container) {
+	input *in = NULL;
+
+	if (*container != NULL && ((*container) -> flags & AVFMT_FLAG_CUSTOM_IO))
+		in = (*container) -> pb -> opaque;
+
+	avformat_close_input(container);
+	input_close(in);
+}
+
+/* A format context that reads through in; without one, libavformat opens
+ * the file itself. */
+static AVFormatContext *scan_container_new(input *in) {
+	AVFormatContext *container;
+
+	if (in == NULL)
+		return NULL;
+
+	container = avformat_alloc_context();
+	if (container == NULL)
+		fail_printf("OOM");
+
+	container -> pb     = input_avio(in);
+	container -> flags |= AVFMT_FLAG_CUSTOM_IO;
+
+	return container;
+}
+
+static pthread_key_t  scan_cache_key;
+static pthread_once_t scan_cache_once = PTHREAD_ONCE_INIT;
+
+static void scan_decoder_drop(scan_decoder *dec) {
+	avcodec_free_context(&dec -> avctx);
+	avcodec_parameters_free(&dec -> par);
+	dec -> busy = 0;
+}
+
+static void scan_cache_free(void *arg) {
+	scan_cache *cache = arg;
+	int i;
+
+	for (i = 0; i < SCAN_CACHE_DECODERS; i++)
+		scan_decoder_drop(&cache -> decoders[i]);
+
+	for (i = 0; i < SCAN_PIPELINE_DEPTH; i++)
+		av_frame_free(&cache -> frames[i]);
+
+	av_packet_free(&cache -> packet);
+	swr_free(&cache -> conv.swr);
+	av_free(cache -> conv.buf);
+	av_free(cache -> conv.raw);
+
+	free(cache);
+}
+
+static void scan_cache_key_init(void) {
+	if (pthread_key_create(&scan_cache_key, scan_cache_free) != 0)
+		fail_printf("Could not create thread key");
+}
+
+/* The calling thread's cache, allocated on first use. */
+static scan_cache *scan_cache_get(void) {
+	scan_cache *cache;
+	int i;
+
+	pthread_once(&scan_cache_once, scan_cache_key_init);
+
+	cache = pthread_getspecific(scan_cache_key);
+	if (cache != NULL)
+		return cache;
+
+	cache = calloc(1, sizeof(scan_cache));
+	if (cache == NULL)
+		fail_printf("OOM");
+
+	cache -> packet   = av_packet_alloc();
+	cache -> conv.swr = swr_alloc();
+	if (cache -> packet == NULL || cache -> conv.swr == NULL)
+		fail_printf("OOM");
+
+	for (i = 0; i < SCAN_PIPELINE_DEPTH; i++) {
+		cache -> frames[i] = av_frame_alloc();
+		if (cache -> frames[i] == NULL)
+			fail_printf("OOM");
+	}
+
+	if (pthread_setspecific(scan_cache_key, cache) != 0)
+		fail_printf("Could not set thread cache");
+
+	return cache;
+}
+
+/* Decoders that avcodec_flush_buffers() takes back to where
+ * avcodec_open2() left them. Others keep state set up from the extradata
+ * or the stream itself (AAC's ASC and implicit SBR, Vorbis and Opus
+ * headers) that a flush does not reset, so they are never reused. None of
+ * these look at the bit rate, which differs between files (VBR). */
+static int scan_decoder_reusable(enum AVCodecID id) {
+	switch (id) {
+		case AV_CODEC_ID_MP2:
+		case AV_CODEC_ID_MP3:
+		case AV_CODEC_ID_FLAC:
+			return 1;
+
+		default:
+			return id >= AV_CODEC_ID_PCM_S16LE && id < AV_CODEC_ID_ADPCM_IMA_QT;
+	}
+}
+
+/* Whether two streams give a decoder the same set-up: everything
+ * avcodec_parameters_to_context() passes on but the bit rate, extradata
+ * included. */
+static int scan_params_equal(const AVCodecParameters *a,
+                             const AVCodecParameters *b) {
+	if (a -> codec_id             != b -> codec_id             ||
+	    a -> codec_tag            != b -> codec_tag            ||
+	    a -> format               != b -> format               ||
+	    a -> bits_per_coded_sample != b -> bits_per_coded_sample ||
+	    a -> bits_per_raw_sample  != b -> bits_per_raw_sample  ||
+	    a -> profile              != b -> profile              ||
+	    a -> level                != b -> level                ||
+	    a -> channel_layout       != b -> channel_layout       ||
+	    a -> channels             != b -> channels             ||
+	    a -> sample_rate          != b -> sample_rate          ||
+	    a -> block_align          != b -> block_align          ||
+	    a -> frame_size           != b -> frame_size           ||
+	    a -> initial_padding      != b -> initial_padding      ||
+	    a -> trailing_padding     != b -> trailing_padding     ||
+	    a -> seek_preroll         != b -> seek_preroll         ||
+	    a -> extradata_size       != b -> extradata_size)
+		return 0;
+
+	return a -> extradata_size == 0 ||
+	       memcmp(a -> extradata, b -> extradata, a -> extradata_size) == 0;
+}
+
+/*
+ * Get a decoder for a stream. One the thread kept from an earlier file is
+ * reused if it was opened for the same parameters: flushed, it starts from
+ * the state avcodec_open2() left it in, so it decodes exactly like a new
+ * one, without allocating its tables again. Otherwise a new one is opened
+ * and kept in place of the one unused the longest (only decoders that can
+ * be reused, see scan_decoder_reusable()). Returns a negative
+ * AVERROR if the decoder could not be opened.
+ */
+static int scan_decoder_open(scan_cache *cache, AVCodec *codec,
+                             const AVCodecParameters *par,
+                             AVCodecContext **avctx, int *reused) {
+	scan_decoder *dec, *slot = NULL;
+	int i, rc, keep = scan_decoder_reusable(par -> codec_id);
+
+	for (i = 0; keep && i < SCAN_CACHE_DECODERS; i++) {
+		dec = &cache -> decoders[i];
+
+		if (dec -> avctx == NULL || dec -> busy ||
+		    dec -> avctx -> codec != codec || !scan_params_equal(dec -> par, par))
+			continue;
+
+		avcodec_flush_buffers(dec -> avctx);
+
+		dec -> avctx -> sample_rate         = dec -> sample_rate;
+		dec -> avctx -> channels            = dec -> channels;
+		dec -> avctx -> channel_layout      = dec -> channel_layout;
+		dec -> avctx -> sample_fmt          = dec -> sample_fmt;
+		dec -> avctx -> frame_size          = dec -> frame_size;
+		dec -> avctx -> bits_per_raw_sample = dec -> bits_per_raw_sample;
+
+		dec -> busy = 1;
+		*avctx  = dec -> avctx;
+		*reused = 1;
+		return 0;
+	}
+
+	*reused = 0;
+
+	*avctx = avcodec_alloc_context3(codec);
+	if (*avctx == NULL)
+		fail_printf("Could not allocate audio codec context!");
+
+	avcodec_parameters_to_context(*avctx, par);
+
+	rc = avcodec_open2(*avctx, codec, NULL);
+	if (rc < 0) {
+		avcodec_free_context(avctx);
+		return rc;
+	}
+
+	for (i = 0; keep && i < SCAN_CACHE_DECODERS; i++) {
+		dec = &cache -> decoders[i];
+
+		if (dec -> busy)
+			continue;
+
+		if (dec -> avctx == NULL) {
+			slot = dec;
+			break;
+		}
+
+		if (slot == NULL || dec -> used < slot -> used)
+			slot = dec;
+	}
+
+	// not reusable, or all taken by files being scanned on this thread
+	if (slot == NULL)
+		return 0;
+
+	scan_decoder_drop(slot);
+
+	slot -> par = avcodec_parameters_alloc();
+	if (slot -> par == NULL || avcodec_parameters_copy(slot -> par, par) < 0)
+		fail_printf("OOM");
+
+	slot -> avctx               = *avctx;
+	slot -> busy                = 1;
+	slot -> sample_rate         = (*avctx) -> sample_rate;
+	slot -> channels            = (*avctx) -> channels;
+	slot -> channel_layout      = (*avctx) -> channel_layout;
+	slot -> sample_fmt          = (*avctx) -> sample_fmt;
+	slot -> frame_size          = (*avctx) -> frame_size;
+	slot -> bits_per_raw_sample = (*avctx) -> bits_per_raw_sample;
+
+	return 0;
+}
+
+/* Give a decoder back: kept for the next file, or freed. */
+static void scan_decoder_close(scan_cache *cache, AVCodecContext **avctx,
+                               int keep) {
+	int i;
+
+	for (i = 0; i < SCAN_CACHE_DECODERS; i++) {
+		scan_decoder *dec = &cache -> decoders[i];
+
+		if (dec -> avctx != *avctx)
+			continue;
+
+		if (keep) {
+			dec -> busy = 0;
+			dec -> used = ++cache -> clock;
+		} else {
+			scan_decoder_drop(dec);
+		}
+
+		*avctx = NULL;
+		return;
+	}
+
+	avcodec_free_context(avctx);
+}
+
+/* Whether the demuxer gave everything the decoder and meter need. */
+static int scan_params_complete(AVFormatContext *container, int stream_id) {
+	AVCodecParameters *par;
+
+	if (stream_id < 0)
+		return 0;
+
+	par = container -> streams[stream_id] -> codecpar;
+
+	return par -> codec_id != AV_CODEC_ID_NONE && par -> channels > 0 &&
+	       par -> sample_rate > 0;
+}
+
+/*
+ * Streams whose container headers hold all codec parameters, and tell
+ * where the stream starts (segments, -T, are positioned from there).
+ */
+static int scan_header_complete(AVStream *stream) {
+	enum AVCodecID id = stream -> codecpar -> codec_id;
+
+	// all PCM variants (WAV, AIFF) come before the first ADPCM codec, and
+	// these always start at zero
+	if ((id >= AV_CODEC_ID_PCM_S16LE && id < AV_CODEC_ID_ADPCM_IMA_QT) ||
+	    id == AV_CODEC_ID_FLAC)
+		return 1;
+
+	// others may not (Opus pre-skip), only if the demuxer knows
+	return (id == AV_CODEC_ID_WAVPACK || id == AV_CODEC_ID_OPUS) &&
+	       stream -> start_time != AV_NOPTS_VALUE;
+}
+
+/*
+ * Opens a file with the demuxer its extension suggests, without probing
+ * the format. For FLAC, WAV, AIFF, WavPack and Opus the headers are all
+ * that is read ("header"); anything else gets a stream info probe over at
+ * most SCAN_PROBE_SIZE bytes and SCAN_PROBE_DURATION ("hint"). Returns
+ * NULL, with no container left open, if there is no hint, the hint is
+ * wrong or the codec parameters are still incomplete: the file is then
+ * opened the usual way.
+ */
+static const char *scan_open_fast(const char *file, input *in,
+                                  AVFormatContext **container) {
+	AVInputFormat *format = NULL;
+	AVDictionary *opts = NULL;
+	const char *ext = strrchr(file, '.'), *how = "header";
+	int stream_id;
+	size_t i;
+
+	for (i = 0; ext != NULL && i < SCAN_NB_HINTS; i++) {
+		if (strcasecmp(ext, scan_hints[i].ext) == 0)
+			format = av_find_input_format(scan_hints[i].format);
+	}
+
+	if (format == NULL)
+		return NULL;
+
+	// also limits avformat_find_stream_info() below
+	av_dict_set_int(&opts, "probesize", SCAN_PROBE_SIZE, 0);
+	av_dict_set_int(&opts, "analyzeduration", SCAN_PROBE_DURATION, 0);
+
+	*container = scan_container_new(in);
+
+	if (avformat_open_input(container, file, format, &opts) < 0) {
+		av_dict_free(&opts);
+		return NULL;
+	}
+
+	av_dict_free(&opts);
+
+	stream_id = av_find_best_stream(*container, AVMEDIA_TYPE_AUDIO,
+	                                -1, -1, NULL, 0);
+
+	if (!scan_params_complete(*container, stream_id) ||
+	    !scan_header_complete((*container) -> streams[stream_id])) {
+		how = "hint";
+
+		if (avformat_find_stream_info(*container, NULL) < 0)
+			goto fail;
+
+		stream_id = av_find_best_stream(*container, AVMEDIA_TYPE_AUDIO,
+		                                -1, -1, NULL, 0);
+	}
+
+	if (!scan_params_complete(*container, stream_id))
+		goto fail;
+
+	return how;
+
+fail:
+	avformat_close_input(container);
+	return NULL;
+}
+
+/* Adds what was read from a file to a track's statistics. */
+static void scan_io_stats(AVFormatContext *container, scan_stats *stats) {
+	input_stats io;
+
+	if (container -> pb != NULL)
+		stats -> bytes_read += container -> pb -> bytes_read;
+
+	if (!(container -> flags & AVFMT_FLAG_CUSTOM_IO)) {
+		stats -> input = "libavformat";
+		return;
+	}
+
+	input_get_stats(container -> pb -> opaque, &io);
+
+	stats -> input       = input_mode(container -> pb -> opaque);
+	stats -> syscalls   += io.calls;
+	stats -> reads      += io.reads;
+	stats -> read_bytes += io.bytes;
+}
+
+static meter *scan_new_meter(AVCodecContext *avctx, const char *engine,
+                             int flags) {
+	return meter_new(avctx -> channels, avctx -> sample_rate, engine, flags);
+}
+
+/*
+ * Split a long track into time segments and analyse them in parallel.
+ * Only done for codecs that decode sample-exactly after a seek. Every
+ * segment decodes a few seconds before its start, so filters and the
+ * 3 s short-term window are warmed up, and records the blocks and peaks a
+ * serial scan would have seen there. Peaks are exact; the filter state
+ * after the warm-up is only close to a serial scan's, so block energies
+ * can differ in their last bits (tests/segment_test.c measures it).
+ * Returns non-zero if the track was not split; it must then be scanned as
+ * a whole.
+ */
+static int scan_segmented(scan_ctx *ctx, unsigned index,
+                          AVFormatContext *container, AVCodecContext *avctx,
+                          int stream_id) {
+	AVStream *stream = container -> streams[stream_id];
+	scan_segment *segs;
+	int64_t hop, total, step;
+	unsigned i, nb = ctx -> opts.segments;
+	int failed = 0;
+
+	switch (avctx -> codec_id) {
+		case AV_CODEC_ID_FLAC:
+		case AV_CODEC_ID_WAVPACK:
+		case AV_CODEC_ID_ALAC:
+			break;
+
+		default:
+			if (avctx -> codec_id >= AV_CODEC_ID_PCM_S16LE &&
+			    avctx -> codec_id <  AV_CODEC_ID_ADPCM_IMA_QT)
+				break;
+
+			// lossy codecs overlap frames and have encoder delay
+			return -1;
+	}
+
+	if (container -> pb == NULL ||
+	    !(container -> pb -> seekable & AVIO_SEEKABLE_NORMAL))
+		return -1;
+
+	if (stream -> duration != AV_NOPTS_VALUE)
+		total = av_rescale_q(stream -> duration, stream -> time_base,
+		                     (AVRational) { 1, avctx -> sample_rate });
+	else if (container -> duration != AV_NOPTS_VALUE)
+		total = av_rescale_q(container -> duration, AV_TIME_BASE_Q,
+		                     (AVRational) { 1, avctx -> sample_rate });
+	else
+		return -1;
+
+	// the other files scanned at once (-j) have their share of CPUs
+	nb = FFMIN(nb, FFMAX(pool_nb_cpus() / FFMAX(ctx -> opts.jobs, 1), 1));
+
+	// segments start on whole seconds, so 100 ms and 1 s blocks line up
+	hop = (avctx -> sample_rate + 5) / 10;
+
+	if (total / (hop * SCAN_SEGMENT_MIN) < nb)
+		nb = total / (hop * SCAN_SEGMENT_MIN);
+
+	if (nb < 2)
+		return -1;
+
+	step = total / nb / (hop * 10) * (hop * 10);
+
+	segs = calloc(nb, sizeof(scan_segment));
+	if (segs == NULL)
+		fail_printf("OOM");
+
+	ok_printf("Analysing in %u segments", nb);
+
+	for (i = 0; i < nb; i++) {
+		segs[i].file  = ctx -> files[index];
+		segs[i].start = i * step;
+		// the last one runs to the actual end of the stream
+		segs[i].end   = (i == nb - 1) ? INT64_MAX : (i + 1) * step;
+
+		segs[i].opts   = &ctx -> opts;
+		segs[i].engine = ctx -> opts.engine;
+		segs[i].flags  = scan_meter_flags(ctx);
+
+		summary_init(&segs[i].sum, avctx -> channels, scan_summary_flags(ctx));
+
+		if (pthread_create(&segs[i].thread, NULL, scan_segment_worker, &segs[i]) != 0)
+			fail_printf("Could not create segment thread");
+	}
+
+	for (i = 0; i < nb; i++) {
+		pthread_join(segs[i].thread, NULL);
+		failed |= segs[i].failed;
+	}
+
+	if (!failed) {
+		summary_init(&ctx -> summaries[index], avctx -> channels,
+		             scan_summary_flags(ctx));
+
+		for (i = 0; i < nb; i++) {
+			summary_merge(&ctx -> summaries[index], &segs[i].sum);
+			// the parts are not needed any more, give the memory back early
+			summary_free(&segs[i].sum);
+		}
+
+		ctx -> stats[index].segments = nb;
+		ctx -> stats[index].engine   = segs[0].used;
+	} else {
+		warn_printf("Could not split '%s', scanning it as a whole",
+		            ctx -> files[index]);
+	}
+
+	for (i = 0; i < nb; i++) {
+		ctx -> stats[index].swr_inits        += segs[i].swr_inits;
+		ctx -> stats[index].peak_parts       += segs[i].peak_parts;
+		ctx -> stats[index].peak_oversampled += segs[i].peak_oversampled;
+		ctx -> stats[index].bytes_read       += segs[i].io.bytes_read;
+		ctx -> stats[index].syscalls         += segs[i].io.syscalls;
+		ctx -> stats[index].reads            += segs[i].io.reads;
+		ctx -> stats[index].read_bytes       += segs[i].io.read_bytes;
+		summary_free(&segs[i].sum);
+	}
+
+	free(segs);
+
+	return failed ? -1 : 0;
+}
+
+/*
+ * Analyse uncompressed PCM in WAV, W64 and AIFF files without decoding
+ * it: the data chunk is read through the file's input (in blocks of the
+ * read size, or from the mapping with -b mmap) and its samples go to the
+ * tap as they are, or converted to what the PCM decoder would have output
+ * (24-bit, big-endian or misaligned data). Only done if the header told
+ * everything (the demuxer is then at the start of the data) and the stream
+ * goes through a single tap. Returns -1 if the file must be decoded as
+ * usual (nothing has been read then), and 1 if reading failed: the tap
+ * has seen part of the track, so the scan has failed.
+ */
+static int scan_raw(scan_ctx *ctx, unsigned index, AVFormatContext *container,
+                    AVCodecContext *avctx, int stream_id, tap *tap,
+                    scan_conv *conv) {
+	AVStream *stream = container -> streams[stream_id];
+	const char *name = container -> iformat -> name;
+	tap_pcm pcm;
+	int64_t start, end, nb, done;
+	size_t frame_size, step, i, n, k;
+	const uint8_t *map = NULL;
+	input *in;
+	int native;
+
+	for (i = 0; i < SCAN_NB_RAW; i++) {
+		if (scan_raw_codecs[i].id == avctx -> codec_id)
+			break;
+	}
+
+	if (i == SCAN_NB_RAW || !(container -> flags & AVFMT_FLAG_CUSTOM_IO) ||
+	    stream -> duration == AV_NOPTS_VALUE ||
+	    strcmp(ctx -> stats[index].probe, "header") != 0)
+		return -1;
+
+	if (strcmp(name, "wav") != 0 && strcmp(name, "w64") != 0 &&
+	    strcmp(name, "aiff") != 0)
+		return -1;
+
+	in         = container -> pb -> opaque;
+	frame_size = scan_raw_codecs[i].size * avctx -> channels;
+	start      = avio_tell(container -> pb);
+	nb         = av_rescale_q(stream -> duration, stream -> time_base,
+	                          (AVRational) { 1, avctx -> sample_rate });
+
+	// a truncated file ends where the demuxer would stop, too
+	nb  = FFMIN(nb, (input_size(in) - start) / (int64_t) frame_size);
+	end = start + nb * frame_size;
+
+	if (nb <= 0)
+		return -1;
+
+	// only mapped if asked for: a mapped file that shrinks while it is
+	// scanned kills the process (SIGBUS), a read just comes up short
+	if (ctx -> opts.read_mode == SCAN_READ_MMAP)
+		map = input_map(in);
+
+	step = SCAN_RAW_FRAMES;
+	if (map == NULL)
+		step = FFMIN(step, FFMAX(1, (ctx -> opts.read_size ?
+		                             ctx -> opts.read_size :
+		                             INPUT_READ_SIZE) / frame_size));
+
+	native = avctx -> codec_id == AV_NE(AV_CODEC_ID_PCM_S16BE, AV_CODEC_ID_PCM_S16LE) ||
+	         avctx -> codec_id == AV_NE(AV_CODEC_ID_PCM_S32BE, AV_CODEC_ID_PCM_S32LE) ||
+	         avctx -> codec_id == AV_NE(AV_CODEC_ID_PCM_F32BE, AV_CODEC_ID_PCM_F32LE) ||
+	         avctx -> codec_id == AV_NE(AV_CODEC_ID_PCM_F64BE, AV_CODEC_ID_PCM_F64LE);
+
+	pcm.type   = scan_raw_codecs[i].type;
+	pcm.stride = scan_raw_codecs[i].out * avctx -> channels;
+
+	progress_bar(0, 0, 0, 0);
+
+	for (done = 0; done < nb; done += n) {
+		const uint8_t *src;
+
+		n = FFMIN(step, nb - done);
+
+		if (map != NULL) {
+			src = map + start + done * frame_size;
+		} else {
+			int64_t got;
+
+			av_fast_malloc(&conv -> raw, &conv -> raw_size, n * frame_size);
+			if (conv -> raw == NULL)
+				fail_printf("OOM");
+
+			got = input_pread(in, start + done * frame_size, conv -> raw,
+			                  n * frame_size);
+			if (got < 0) {
+				err_printf("Error while reading '%s'", ctx -> files[index]);
+				progress_bar(2, 0, 0, 0);
+				return 1;
+			}
+
+			// cut short: the track ends here, as it would when decoded
+			if (got < (int64_t) (n * frame_size)) {
+				n   = got / frame_size;
+				nb  = done + n;
+				end = start + nb * frame_size;
+			}
+
+			if (n == 0)
+				break;
+
+			src = conv -> raw;
+		}
+
+		if (native && (uintptr_t) src % scan_raw_codecs[i].size == 0) {
+			pcm.data = src;
+		} else {
+			size_t nb_samples = n * avctx -> channels;
+
+			av_fast_malloc(&conv -> buf, &conv -> buf_size, n * pcm.stride);
+			if (conv -> buf == NULL)
+				fail_printf("OOM");
+
+			for (k = 0; k < nb_samples; k++) {
+				const uint8_t *p = src + k * scan_raw_codecs[i].size;
+				uint32_t u32;
+				uint64_t u64;
+
+				switch (avctx -> codec_id) {
+					case AV_CODEC_ID_PCM_S16BE:
+						((int16_t *) conv -> buf)[k] = AV_RB16(p);
+						break;
+
+					case AV_CODEC_ID_PCM_S24LE:
+						((uint32_t *) conv -> buf)[k] = AV_RL24(p) << 8;
+						break;
+
+					case AV_CODEC_ID_PCM_S24BE:
+						((uint32_t *) conv -> buf)[k] = AV_RB24(p) << 8;
+						break;
+
+					case AV_CODEC_ID_PCM_S32BE:
+					case AV_CODEC_ID_PCM_F32BE:
+						u32 = AV_RB32(p);
+						memcpy(conv -> buf + k * 4, &u32, 4);
+						break;
+
+					case AV_CODEC_ID_PCM_F64BE:
+						u64 = AV_RB64(p);
+						memcpy(conv -> buf + k * 8, &u64, 8);
+						break;
+
+					default:
+						// native, but not aligned
+						memcpy(conv -> buf + k * scan_raw_codecs[i].out, p,
+						       scan_raw_codecs[i].out);
+						break;
+				}
+			}
+
+			pcm.data = conv -> buf;
+		}
+
+		tap_add(tap, &pcm, 0, n);
+		input_seen(in, start + (done + n) * frame_size);
+
+		progress_bar(1, (done + n) / avctx -> sample_rate,
+		             nb / avctx -> sample_rate, 0);
+	}
+
+	progress_bar(2, 0, 0, 0);
+
+	ctx -> stats[index].bytes_read += end - start;
+	ctx -> stats[index].raw = 1;
+
+	return 0;
+}
+
+static void *scan_segment_worker(void *arg) {
+	scan_segment *seg = arg;
+
+	AVFormatContext *container = NULL;
+	AVCodec *codec;
+	AVCodecContext *avctx;
+	AVStream *stream;
+
+	// a thread of its own, so a cache of its own
+	scan_cache *cache = scan_cache_get();
+	AVPacket *packet = cache -> packet;
+	AVFrame *frame = cache -> frames[0];
+
+	tap_pcm pcm;
+	tap tap;
+	meter *meter;
+
+	int rc, stream_id, reused, done = 0;
+	const char *probe;
+	int64_t hop, origin, pos = -1, start_pts;
+
+	if (scan_open_input(cache, seg -> opts, seg -> file, &container, &codec,
+	                    &avctx, &stream_id, &probe, &reused) < 0) {
+		seg -> failed = 1;
+		return NULL;
+	}
+
+	stream = container -> streams[stream_id];
+	start_pts = (stream -> start_time != AV_NOPTS_VALUE) ? stream -> start_time : 0;
+
+	hop    = (avctx -> sample_rate + 5) / 10;
+	origin = FFMAX(0, seg -> start - SCAN_SEGMENT_PREROLL * hop);
+
+	meter = scan_new_meter(avctx, seg -> engine, seg -> flags);
+	tap_init(&tap, meter, &seg -> sum, origin, seg -> start, seg -> end);
+	seg -> used = meter_engine(meter);
+
+	cache -> conv.nb_inits = 0;
+
+	if (origin > 0) {
+		int64_t ts = start_pts + av_rescale_q(origin,
+			(AVRational) { 1, avctx -> sample_rate }, stream -> time_base);
+
+		if (av_seek_frame(container, stream_id, ts, AVSEEK_FLAG_BACKWARD) < 0)
+			seg -> failed = 1;
+	} else {
+		// the first segment counts frames exactly like a serial scan
+		pos = 0;
+	}
+
+	while (!done && !seg -> failed && av_read_frame(container, packet) >= 0) {
+		if (packet -> stream_index != stream_id) {
+			av_packet_unref(packet);
+			continue;
+		}
+
+		// a decode error fails the segment, as it would fail a serial scan
+		rc = avcodec_send_packet(avctx, packet);
+		if (rc < 0 && rc != AVERROR(EAGAIN))
+			seg -> failed = 1;
+
+		while (rc >= 0 && !done && !seg -> failed) {
+			int64_t skip, nb;
+
+			rc = avcodec_receive_frame(avctx, frame);
+			if (rc < 0) {
+				if (rc != AVERROR(EAGAIN) && rc != AVERROR_EOF)
+					seg -> failed = 1;
+				break;
+			}
+
+			if (origin > 0) {
+				int64_t at;
+
+				if (frame -> pts == AV_NOPTS_VALUE) {
+					seg -> failed = 1;
+					break;
+				}
+
+				at = av_rescale_q(frame -> pts - start_pts, stream -> time_base,
+				                  (AVRational) { 1, avctx -> sample_rate });
+
+				// landed after the pre-roll, or frames are missing
+				if ((pos < 0 && at > origin) || (pos >= 0 && at != pos)) {
+					seg -> failed = 1;
+					break;
+				}
+
+				pos = at;
+			}
+
+			skip = FFMAX(0, origin - pos);
+			nb   = FFMIN(pos + frame -> nb_samples, seg -> end) - (pos + skip);
+
+			if (nb > 0) {
+				scan_convert(frame, &cache -> conv, &pcm);
+				tap_add(&tap, &pcm, skip, nb);
+			}
+
+			pos += frame -> nb_samples;
+			av_frame_unref(frame);
+			if (pos >= seg -> end)
+				done = 1;
+		}
+
+		av_packet_unref(packet);
+	}
+
+	seg -> swr_inits  = cache -> conv.nb_inits;
+	scan_io_stats(container, &seg -> io);
+	meter_stats(meter, &seg -> peak_parts, &seg -> peak_oversampled);
+
+	av_frame_unref(frame);
+	meter_free(meter);
+	// nothing more to decode on this thread
+	scan_decoder_close(cache, &avctx, 0);
+	scan_close_input(&container);
+
+	return NULL;
+}
+
+static void scan_sink_open(scan_sink *sink, tap *tap, chan_split *split,
+                           scan_cache *cache, int threaded) {
+	int i;
+
+	memset(sink, 0, sizeof(scan_sink));
+
+	sink -> tap      = tap;
+	sink -> split    = split;
+	sink -> conv     = &cache -> conv;
+	sink -> threaded = threaded;
+	sink -> frames   = cache -> frames;
+
+	if (!threaded) {
+		sink -> frame = sink -> frames[0];
+		return;
+	}
+
+	sink -> full  = ring_new(SCAN_PIPELINE_DEPTH);
+	sink -> empty = ring_new(SCAN_PIPELINE_DEPTH);
+
+	// the decoder holds one frame, the rest wait in the empty ring
+	sink -> frame = sink -> frames[0];
+	for (i = 1; i < SCAN_PIPELINE_DEPTH; i++)
+		ring_push(sink -> empty, sink -> frames[i]);
+
+	if (pthread_create(&sink -> thread, NULL, scan_sink_worker, sink) != 0)
+		fail_printf("Could not create analysis thread");
+}
+
+static void scan_sink_put(scan_sink *sink) {
+	if (!sink -> threaded) {
+		scan_frame(sink, sink -> frame);
+		return;
+	}
+
+	ring_push(sink -> full, sink -> frame);
+	sink -> frame = ring_pop(sink -> empty);
+}
+
+static void scan_sink_close(scan_sink *sink) {
+	int i;
+
+	if (!sink -> threaded) {
+		av_frame_unref(sink -> frame);
+		return;
+	}
+
+	// NULL tells the analysis thread that the stream is done
+	ring_push(sink -> full, NULL);
+	pthread_join(sink -> thread, NULL);
+
+	// the frames stay with the thread's cache, for the next file
+	for (i = 0; i < SCAN_PIPELINE_DEPTH; i++)
+		av_frame_unref(sink -> frames[i]);
+
+	ring_free(sink -> full);
+	ring_free(sink -> empty);
+}
+
+static void *scan_sink_worker(void *arg) {
+	scan_sink *sink = arg;
+	AVFrame *frame;
+
+	while ((frame = ring_pop(sink -> full)) != NULL) {
+		scan_frame(sink, frame);
+		av_frame_unref(frame);
+		ring_push(sink -> empty, frame);
+	}
+
+	return NULL;
+}
+
+/*
+ * Interleave planar samples into the conversion buffer, one function per
+ * sample type.
+ */
+#define SCAN_PLANAR(NAME, TYPE)                                               \
+static void NAME(AVFrame *frame, scan_conv *conv) {                           \
+	int ch, i;                                                                  \
+	int channels = frame -> channels;                                           \
+	int nb_samples = frame -> nb_samples;                                       \
+	TYPE *out;                                                                  \
+                                                                              \
+	av_fast_malloc(&conv -> buf, &conv -> buf_size,                             \
+	               sizeof(TYPE) * channels * nb_samples);                       \
+	if (conv -> buf == NULL)                                                    \
+		fail_printf("OOM");                                                       \
+                                                                              \
+	out = (TYPE *) conv -> buf;                                                 \
+                                                                              \
+	for (ch = 0; ch < channels; ch++) {                                         \
+		const TYPE *in = (const TYPE *) frame -> extended_data[ch];               \
+                                                                              \
+		for (i = 0; i < nb_samples; i++)                                          \
+			out[i * channels + ch] = in[i];                                         \
+	}                                                                           \
+}
+
+SCAN_PLANAR(scan_planar_s16, short)
+SCAN_PLANAR(scan_planar_s32, int)
+SCAN_PLANAR(scan_planar_flt, float)
+SCAN_PLANAR(scan_planar_dbl, double)
+
+static void scan_frame(scan_sink *sink, AVFrame *frame) {
+	tap_pcm pcm;
+
+	if (sink -> split != NULL) {
+		chan_split_add(sink -> split, frame);
+		return;
+	}
+
+	scan_convert(frame, sink -> conv, &pcm);
+	tap_add(sink -> tap, &pcm, 0, frame -> nb_samples);
+}
+
+static void scan_convert(AVFrame *frame, scan_conv *conv, tap_pcm *pcm) {
+	int rc;
+
+	size_t              out_size;
+	int                 out_linesize;
+	// float keeps headroom, so peaks above 0 dBFS survive the conversion
+	enum AVSampleFormat out_fmt = AV_SAMPLE_FMT_FLT;
+
+	switch (frame -> format) {
+		case AV_SAMPLE_FMT_S16:
+		case AV_SAMPLE_FMT_S16P:
+			pcm -> type   = TAP_S16;
+			pcm -> stride = sizeof(short) * frame -> channels;
+			break;
+
+		case AV_SAMPLE_FMT_S32:
+		case AV_SAMPLE_FMT_S32P:
+			pcm -> type   = TAP_S32;
+			pcm -> stride = sizeof(int) * frame -> channels;
+			break;
+
+		case AV_SAMPLE_FMT_DBL:
+		case AV_SAMPLE_FMT_DBLP:
+			pcm -> type   = TAP_DBL;
+			pcm -> stride = sizeof(double) * frame -> channels;
+			break;
+
+		default:
+			// FLT, FLTP, and everything that goes through the resampler
+			pcm -> type   = TAP_FLT;
+			pcm -> stride = sizeof(float) * frame -> channels;
+			break;
+	}
+
+	switch (frame -> format) {
+		case AV_SAMPLE_FMT_S16:
+		case AV_SAMPLE_FMT_S32:
+		case AV_SAMPLE_FMT_FLT:
+		case AV_SAMPLE_FMT_DBL:
+			pcm -> data = frame -> data[0];
+			return;
+
+		case AV_SAMPLE_FMT_S16P:
+			scan_planar_s16(frame, conv);
+			pcm -> data = conv -> buf;
+			return;
+
+		case AV_SAMPLE_FMT_S32P:
+			scan_planar_s32(frame, conv);
+			pcm -> data = conv -> buf;
+			return;
+
+		case AV_SAMPLE_FMT_FLTP:
+			scan_planar_flt(frame, conv);
+			pcm -> data = conv -> buf;
+			return;
+
+		case AV_SAMPLE_FMT_DBLP:
+			scan_planar_dbl(frame, conv);
+			pcm -> data = conv -> buf;
+			return;
+
+		default:
+			// U8, S64 and whatever comes next
+			break;
+	}
+
+	if (!swr_is_initialized(conv -> swr) ||
+	    conv -> in_fmt      != frame -> format ||
+	    conv -> in_channels != frame -> channels ||
+	    conv -> in_rate     != frame -> sample_rate ||
+	    conv -> in_layout   != frame -> channel_layout) {
+		swr_close(conv -> swr);
+
+		av_opt_set_channel_layout(conv -> swr, "in_channel_layout", frame -> channel_layout, 0);
+		av_opt_set_channel_layout(conv -> swr, "out_channel_layout", frame -> channel_layout, 0);
+
+		// add channel count to properly handle .wav reading
+		av_opt_set_int(conv -> swr, "in_channel_count",  frame -> channels, 0);
+		av_opt_set_int(conv -> swr, "out_channel_count", frame -> channels, 0);
+
+		av_opt_set_int(conv -> swr, "in_sample_rate", frame -> sample_rate, 0);
+		av_opt_set_int(conv -> swr, "out_sample_rate", frame -> sample_rate, 0);
+		av_opt_set_sample_fmt(conv -> swr, "in_sample_fmt", frame -> format, 0);
+		av_opt_set_sample_fmt(conv -> swr, "out_sample_fmt", out_fmt, 0);
+
+		rc = swr_init(conv -> swr);
+		if (rc < 0) {
+			char errbuf[2048];
+			av_strerror(rc, errbuf, 2048);
+
+			fail_printf("Could not open SWResample: %s", errbuf);
+		}
+
+		conv -> in_fmt      = frame -> format;
+		conv -> in_channels = frame -> channels;
+		conv -> in_rate     = frame -> sample_rate;
+		conv -> in_layout   = frame -> channel_layout;
+		conv -> nb_inits++;
 	}
 
 	out_size = av_samples_get_buffer_size(
 		&out_linesize, frame -> channels, frame -> nb_samples, out_fmt, 0
 	);
 
-	out_data = av_malloc(out_size);
+	av_fast_malloc(&conv -> buf, &conv -> buf_size, out_size);
+	if (conv -> buf == NULL)
+		fail_printf("OOM");
 
 	if (swr_convert(
-		swr, (uint8_t**) &out_data, frame -> nb_samples,
-		(const uint8_t**) frame -> data, frame -> nb_samples
+		conv -> swr, &conv -> buf, frame -> nb_samples,
+		(const uint8_t**) frame -> extended_data, frame -> nb_samples
 	) < 0)
 		fail_printf("Cannot convert");
 
-	rc = ebur128_add_frames_short(
-		ebur128, (short *) out_data, frame -> nb_samples
-	);
-
-	if (rc != EBUR128_SUCCESS)
-		err_printf("Error filtering");
-
-	swr_close(swr);
-	av_free(out_data);
+	pcm -> data = conv -> buf;
 }
 
 static void scan_av_log(void *avcl, int level, const char *fmt, va_list args) {
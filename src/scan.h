@@ -32,10 +32,19 @@
 extern "C" {
 #endif
 
+/* What a scan measures besides the integrated loudness (and gain). */
+#define SCAN_RANGE        1  // loudness range
+#define SCAN_SAMPLE_PEAK  2
+#define SCAN_TRUE_PEAK    4  // (track and album peaks are the higher peak)
+#define SCAN_MAXIMA       8  // maximum momentary and short-term loudness
+
+#define SCAN_PEAKS (SCAN_SAMPLE_PEAK | SCAN_TRUE_PEAK)
+
 typedef struct {
 	char *file;
 	char *container;
 	int   codec_id;
+	int   measured;     // SCAN_* flags: values not measured are zero
 
 	double track_gain;
 	double track_peak;
@@ -49,20 +58,78 @@ typedef struct {
 	double album_loudness;
 	double album_loudness_range;
 
+	double track_momentary_max;
+	double track_shortterm_max;
+	double album_momentary_max;
+	double album_shortterm_max;
+
 	double loudness_reference;
 } scan_result;
 
-int scan_init(unsigned nb_files);
-void scan_deinit(void);
+/* How files are read (see -b): large read()s, a mapping of the whole
+ * file, or io_uring read-ahead (read()s where it is not available). */
+enum { SCAN_READ, SCAN_READ_MMAP, SCAN_READ_URING };
+
+/* Scanner options; an all-zero struct gives the default behaviour. */
+typedef struct {
+	int pipeline;         // decode and analyse on two threads per file
+	unsigned segments;    // split long seekable files into up to n parts
+	int keep_going;       // skip files that cannot be opened, don't exit
+	int histogram;        // count blocks in 0.1 LU bins (constant memory)
+	int track_only;       // no album values needed: keep no blocks
+	const char *engine;   // loudness engine (see meter.h), NULL: "auto"
+	const char *profile;  // analysis profile (scan_profile()), NULL: "full"
+	int read_mode;        // how files are read (SCAN_READ_*)
+	size_t read_size;     // bytes per read() from a file, 0: 1 MiB
+	int no_cache;         // leave the page cache as it was before a scan
+	unsigned jobs;        // files scanned at once, sharing the CPUs: 0 = 1
+} scan_options;
+
+/* Per-track scanner statistics, for diagnostics (-X). */
+typedef struct {
+	unsigned swr_inits;   // number of resampler (re)initialisations
+	unsigned segments;    // parts analysed in parallel (0: not split)
+	unsigned channel_threads; // threads filtering channels (0: not split)
+	size_t summary_size;  // bytes kept for the track after its scan
+	unsigned long peak_parts;       // parts of the input seen by true peak
+	unsigned long peak_oversampled; // and those that had to be oversampled
+	unsigned long long bytes_read; // from the file(s), all threads together
+	unsigned long syscalls;         // made to read them (0: libavformat's)
+	unsigned long reads;            // of which read()s
+	unsigned long long read_bytes;  // bytes they returned, or copied
+	const char *input;    // how the file was read: read, mmap, uring or libavformat
+	const char *engine;   // loudness engine that analysed the track
+	const char *probe;    // how the file was opened: header, hint or full
+	int decoder_reused;   // decoder kept from an earlier file on the thread
+	int raw;              // PCM read straight from the file, not decoded
+} scan_stats;
+
+/* All scanner state lives in a scan_ctx, one per album (or batch of
+ * tracks). Contexts are independent of each other, and scan_file() may be
+ * called concurrently on the same context as long as every call uses a
+ * different index. */
+typedef struct scan_ctx scan_ctx;
+
+scan_ctx *scan_init(unsigned nb_files);
+void scan_deinit(scan_ctx *ctx);
+
+void scan_set_options(scan_ctx *ctx, const scan_options *opts);
+int scan_engine_valid(const char *engine);
+int scan_profile(const char *profile);
+
+int scan_album_has_different_codecs(scan_ctx *ctx);
+int scan_album_has_different_containers(scan_ctx *ctx);
+int scan_album_has_opus(scan_ctx *ctx);
+int scan_file(scan_ctx *ctx, const char *file, unsigned index);
+
+scan_result *scan_get_track_result(scan_ctx *ctx, unsigned index, double pre_gain);
 
-int scan_album_has_different_codecs(void);
-int scan_album_has_different_containers(void);
-int scan_album_has_opus(void);
-int scan_file(const char *file, unsigned index);
+/* Album values are aggregated once, on the first of these calls, so they
+ * must only be used after every track of the album has been scanned. */
+double scan_get_album_peak(scan_ctx *ctx);
+void scan_set_album_result(scan_ctx *ctx, scan_result *result, double pre_amp);
 
-scan_result *scan_get_track_result(unsigned index, double pre_gain);
-double scan_get_album_peak();
-void scan_set_album_result(scan_result *result, double pre_amp);
+const scan_stats *scan_get_stats(scan_ctx *ctx, unsigned index);
 
 #ifdef __cplusplus
 }
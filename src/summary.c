@@ -0,0 +1,510 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "summary.h"
+#include "printf.h"
+
+// blocks below -70 LUFS never count (absolute gate, BS.1770-4)
+#define SUMMARY_ABS_GATE (pow(10.0, (-70.0 + 0.691) / 10.0))
+
+static void summary_blocks_merge(summary_blocks *dst, const summary_blocks *src);
+static double summary_blocks_power(const summary_blocks *b);
+static void summary_blocks_gated(const summary_blocks *b, double gate,
+                                 double *power, size_t *count);
+static int summary_blocks_range(summary **s, size_t nb, double gate,
+                                double *lo, double *hi);
+static int summary_hist_range(summary **s, size_t nb, double gate,
+                              double *lo, double *hi);
+static unsigned summary_bin(double energy);
+static double summary_bin_energy(unsigned bin);
+static double summary_select(double *v, size_t n, size_t k);
+
+void summary_init(summary *s, unsigned channels, int flags) {
+	memset(s, 0, sizeof(summary));
+
+	s -> channels = channels;
+
+	s -> sample_peak = calloc(channels, sizeof(double));
+	s -> true_peak   = calloc(channels, sizeof(double));
+	if (s -> sample_peak == NULL || s -> true_peak == NULL)
+		fail_printf("OOM");
+
+	if (flags & SUMMARY_HISTOGRAM) {
+		s -> gating.hist    = calloc(SUMMARY_BINS, sizeof(unsigned long));
+		s -> shortterm.hist = calloc(SUMMARY_BINS, sizeof(unsigned long));
+		if (s -> gating.hist == NULL || s -> shortterm.hist == NULL)
+			fail_printf("OOM");
+	}
+}
+
+void summary_free(summary *s) {
+	free(s -> gating.energies);
+	free(s -> gating.hist);
+	free(s -> shortterm.energies);
+	free(s -> shortterm.hist);
+	free(s -> sample_peak);
+	free(s -> true_peak);
+
+	memset(s, 0, sizeof(summary));
+}
+
+/* Give back the spare room of the block lists once a track is complete. */
+void summary_shrink(summary *s) {
+	summary_blocks *lists[2] = { &s -> gating, &s -> shortterm };
+	unsigned i;
+
+	for (i = 0; i < 2; i++) {
+		summary_blocks *b = lists[i];
+		double *energies;
+
+		if (b -> alloc == b -> size)
+			continue;
+
+		if (b -> size == 0) {
+			free(b -> energies);
+			b -> energies = NULL;
+			b -> alloc    = 0;
+			continue;
+		}
+
+		energies = realloc(b -> energies, sizeof(double) * b -> size);
+		if (energies == NULL)
+			fail_printf("OOM");
+
+		b -> energies = energies;
+		b -> alloc    = b -> size;
+	}
+}
+
+/* Forget the blocks, keeping only the peaks; loudness can no longer be
+ * computed from this summary afterwards. */
+void summary_drop_blocks(summary *s) {
+	free(s -> gating.energies);
+	free(s -> gating.hist);
+	free(s -> shortterm.energies);
+	free(s -> shortterm.hist);
+
+	memset(&s -> gating, 0, sizeof(summary_blocks));
+	memset(&s -> shortterm, 0, sizeof(summary_blocks));
+}
+
+/* Heap memory held by a summary, in bytes. */
+size_t summary_size(const summary *s) {
+	size_t size = 2 * sizeof(double) * s -> channels;
+
+	size += sizeof(double) * (s -> gating.alloc + s -> shortterm.alloc);
+
+	if (s -> gating.hist != NULL)
+		size += sizeof(unsigned long) * SUMMARY_BINS;
+
+	if (s -> shortterm.hist != NULL)
+		size += sizeof(unsigned long) * SUMMARY_BINS;
+
+	return size;
+}
+
+void summary_add_gating(summary *s, double energy) {
+	if (energy >= SUMMARY_ABS_GATE)
+		summary_blocks_add(&s -> gating, energy);
+}
+
+void summary_add_shortterm(summary *s, double energy) {
+	if (energy >= SUMMARY_ABS_GATE)
+		summary_blocks_add(&s -> shortterm, energy);
+}
+
+void summary_add_peak(summary *s, unsigned ch,
+                      double sample_peak, double true_peak) {
+	if (sample_peak > s -> sample_peak[ch])
+		s -> sample_peak[ch] = sample_peak;
+
+	if (true_peak > s -> true_peak[ch])
+		s -> true_peak[ch] = true_peak;
+}
+
+/* Append src to dst; src must cover the audio right after dst. */
+void summary_merge(summary *dst, const summary *src) {
+	unsigned ch;
+
+	summary_blocks_merge(&dst -> gating, &src -> gating);
+	summary_blocks_merge(&dst -> shortterm, &src -> shortterm);
+
+	for (ch = 0; ch < dst -> channels && ch < src -> channels; ch++)
+		summary_add_peak(dst, ch, src -> sample_peak[ch], src -> true_peak[ch]);
+}
+
+double summary_energy(double loudness) {
+	if (isinf(loudness) && loudness < 0)
+		return 0.0;
+
+	return pow(10.0, (loudness + 0.691) / 10.0);
+}
+
+double summary_loudness(double energy) {
+	if (energy <= 0.0)
+		return -HUGE_VAL;
+
+	return 10.0 * log10(energy) - 0.691;
+}
+
+/* Integrated loudness: mean of all blocks above the relative gate, which
+ * sits 10 LU below the mean of all blocks above the absolute gate. */
+void summary_loudness_global(summary **s, size_t nb, double *out) {
+	double sum = 0.0, gate, gated = 0.0;
+	size_t i, count = 0, above = 0;
+
+	for (i = 0; i < nb; i++) {
+		sum   += summary_blocks_power(&s[i] -> gating);
+		count += s[i] -> gating.size;
+	}
+
+	if (count == 0) {
+		*out = -HUGE_VAL;
+		return;
+	}
+
+	gate = sum / (double) count * pow(10.0, -10.0 / 10.0);
+
+	for (i = 0; i < nb; i++)
+		summary_blocks_gated(&s[i] -> gating, gate, &gated, &above);
+
+	if (above == 0) {
+		*out = -HUGE_VAL;
+		return;
+	}
+
+	*out = summary_loudness(gated / (double) above);
+}
+
+/* Loudness range (EBU Tech 3342): spread between the 10th and 95th
+ * percentile of the short-term blocks above a -20 LU relative gate. */
+void summary_loudness_range(summary **s, size_t nb, double *out) {
+	double power = 0.0, gate, lo = 0.0, hi = 0.0;
+	size_t i, size = 0;
+	int hist = 0, rc;
+
+	for (i = 0; i < nb; i++) {
+		power += summary_blocks_power(&s[i] -> shortterm);
+		size  += s[i] -> shortterm.size;
+		hist  |= s[i] -> shortterm.hist != NULL;
+	}
+
+	if (size == 0) {
+		*out = 0.0;
+		return;
+	}
+
+	gate = pow(10.0, -20.0 / 10.0) * (power / (double) size);
+
+	if (hist)
+		rc = summary_hist_range(s, nb, gate, &lo, &hi);
+	else
+		rc = summary_blocks_range(s, nb, gate, &lo, &hi);
+
+	*out = rc ? summary_loudness(hi) - summary_loudness(lo) : 0.0;
+}
+
+/* Highest true peak (or sample peak, if higher) over all channels. */
+double summary_peak(const summary *s) {
+	double peak = 0.0;
+	unsigned ch;
+
+	for (ch = 0; ch < s -> channels; ch++) {
+		peak = fmax(peak, s -> sample_peak[ch]);
+		peak = fmax(peak, s -> true_peak[ch]);
+	}
+
+	return peak;
+}
+
+void summary_blocks_add(summary_blocks *b, double energy) {
+	if (energy > b -> max)
+		b -> max = energy;
+
+	if (b -> hist != NULL) {
+		b -> hist[summary_bin(energy)]++;
+		b -> size++;
+		return;
+	}
+
+	if (b -> size == b -> alloc) {
+		size_t alloc = b -> alloc ? b -> alloc * 2 : 1024;
+		double *energies = realloc(b -> energies, sizeof(double) * alloc);
+
+		if (energies == NULL)
+			fail_printf("OOM");
+
+		b -> energies = energies;
+		b -> alloc    = alloc;
+	}
+
+	b -> energies[b -> size++] = energy;
+}
+
+static void summary_blocks_merge(summary_blocks *dst, const summary_blocks *src) {
+	double max = fmax(dst -> max, src -> max);
+	size_t i;
+
+	if (src -> hist == NULL) {
+		for (i = 0; i < src -> size; i++)
+			summary_blocks_add(dst, src -> energies[i]);
+
+		return;
+	}
+
+	for (i = 0; i < SUMMARY_BINS; i++) {
+		unsigned long n;
+
+		if (dst -> hist != NULL) {
+			dst -> hist[i] += src -> hist[i];
+			dst -> size    += src -> hist[i];
+			continue;
+		}
+
+		// an exact summary cannot get its blocks back, use the bin centres
+		for (n = 0; n < src -> hist[i]; n++)
+			summary_blocks_add(dst, summary_bin_energy(i));
+	}
+
+	// but not for the maximum, which bins do not change
+	dst -> max = max;
+}
+
+/* Sum of the energies of all blocks (bin centres in histogram mode). */
+static double summary_blocks_power(const summary_blocks *b) {
+	double power = 0.0;
+	size_t i;
+
+	if (b -> hist != NULL) {
+		for (i = 0; i < SUMMARY_BINS; i++) {
+			if (b -> hist[i] > 0)
+				power += b -> hist[i] * summary_bin_energy(i);
+		}
+	} else {
+		for (i = 0; i < b -> size; i++)
+			power += b -> energies[i];
+	}
+
+	return power;
+}
+
+/* Add the energies and number of blocks at or above gate. */
+static void summary_blocks_gated(const summary_blocks *b, double gate,
+                                 double *power, size_t *count) {
+	size_t i;
+
+	if (b -> hist != NULL) {
+		for (i = 0; i < SUMMARY_BINS; i++) {
+			double energy = summary_bin_energy(i);
+
+			if (b -> hist[i] > 0 && energy >= gate) {
+				*power += b -> hist[i] * energy;
+				*count += b -> hist[i];
+			}
+		}
+	} else {
+		for (i = 0; i < b -> size; i++) {
+			if (b -> energies[i] >= gate) {
+				*power += b -> energies[i];
+				(*count)++;
+			}
+		}
+	}
+}
+
+/*
+ * LRA percentiles of exact short-term blocks. Only two order statistics
+ * are needed, so they are selected, not sorted for.
+ */
+static int summary_blocks_range(summary **s, size_t nb, double gate,
+                                double *lo, double *hi) {
+	double *gated;
+	size_t i, j, size = 0, gated_size = 0, k_lo, k_hi;
+
+	for (i = 0; i < nb; i++)
+		size += s[i] -> shortterm.size;
+
+	gated = malloc(sizeof(double) * size);
+	if (gated == NULL)
+		fail_printf("OOM");
+
+	for (i = 0; i < nb; i++) {
+		for (j = 0; j < s[i] -> shortterm.size; j++) {
+			if (s[i] -> shortterm.energies[j] >= gate)
+				gated[gated_size++] = s[i] -> shortterm.energies[j];
+		}
+	}
+
+	if (gated_size == 0) {
+		free(gated);
+		return 0;
+	}
+
+	k_hi = (size_t) ((gated_size - 1) * 0.95 + 0.5);
+	k_lo = (size_t) ((gated_size - 1) * 0.1 + 0.5);
+
+	// everything below k_hi is not larger afterwards
+	*hi = summary_select(gated, gated_size, k_hi);
+	*lo = k_lo < k_hi ? summary_select(gated, k_hi, k_lo) : *hi;
+
+	free(gated);
+
+	return 1;
+}
+
+/*
+ * LRA percentiles from histograms: bin centres are walked upwards until the
+ * wanted number of blocks has been passed. Exact blocks in the mix are
+ * binned first.
+ */
+static int summary_hist_range(summary **s, size_t nb, double gate,
+                              double *lo, double *hi) {
+	unsigned long *hist;
+	size_t i, j, gated_size = 0, k_lo, k_hi, seen = 0;
+	int found_lo = 0;
+
+	hist = calloc(SUMMARY_BINS, sizeof(unsigned long));
+	if (hist == NULL)
+		fail_printf("OOM");
+
+	for (i = 0; i < nb; i++) {
+		const summary_blocks *b = &s[i] -> shortterm;
+
+		if (b -> hist != NULL) {
+			for (j = 0; j < SUMMARY_BINS; j++)
+				hist[j] += b -> hist[j];
+		} else {
+			for (j = 0; j < b -> size; j++)
+				hist[summary_bin(b -> energies[j])]++;
+		}
+	}
+
+	for (j = 0; j < SUMMARY_BINS; j++) {
+		if (summary_bin_energy(j) < gate)
+			hist[j] = 0;
+
+		gated_size += hist[j];
+	}
+
+	if (gated_size == 0) {
+		free(hist);
+		return 0;
+	}
+
+	k_hi = (size_t) ((gated_size - 1) * 0.95 + 0.5);
+	k_lo = (size_t) ((gated_size - 1) * 0.1 + 0.5);
+
+	for (j = 0; j < SUMMARY_BINS; j++) {
+		seen += hist[j];
+
+		if (!found_lo && seen > k_lo) {
+			*lo = summary_bin_energy(j);
+			found_lo = 1;
+		}
+
+		if (seen > k_hi) {
+			*hi = summary_bin_energy(j);
+			break;
+		}
+	}
+
+	free(hist);
+
+	return 1;
+}
+
+/* Bin i covers [-70 + i / 10, -70 + (i + 1) / 10) LUFS; louder blocks go
+ * into the last bin. */
+static unsigned summary_bin(double energy) {
+	double loudness = summary_loudness(energy);
+	int bin;
+
+	if (!(loudness > -70.0))
+		return 0;
+
+	bin = (int) ((loudness + 70.0) * 10.0);
+
+	if (bin >= SUMMARY_BINS)
+		return SUMMARY_BINS - 1;
+
+	return (unsigned) bin;
+}
+
+static double summary_bin_energy(unsigned bin) {
+	return summary_energy(bin / 10.0 - 69.95);
+}
+
+/*
+ * Quickselect: reorder v so that v[k] is the value it would have if v were
+ * sorted, with nothing larger before and nothing smaller after it.
+ */
+static double summary_select(double *v, size_t n, size_t k) {
+	size_t lo = 0, hi = n - 1;
+
+	while (lo < hi) {
+		size_t i = lo, j = hi, mid = lo + (hi - lo) / 2;
+		double pivot, tmp;
+
+		// median of three, so sorted input is not the worst case
+		if (v[mid] < v[lo]) { tmp = v[mid]; v[mid] = v[lo]; v[lo] = tmp; }
+		if (v[hi] < v[lo])  { tmp = v[hi];  v[hi]  = v[lo]; v[lo] = tmp; }
+		if (v[hi] < v[mid]) { tmp = v[hi];  v[hi]  = v[mid]; v[mid] = tmp; }
+
+		pivot = v[mid];
+
+		while (i <= j) {
+			while (v[i] < pivot)
+				i++;
+			while (v[j] > pivot)
+				j--;
+
+			if (i <= j) {
+				tmp = v[i]; v[i] = v[j]; v[j] = tmp;
+				i++;
+				if (j == 0)
+					break;
+				j--;
+			}
+		}
+
+		if (k <= j)
+			hi = j;
+		else if (k >= i)
+			lo = i;
+		else
+			break;
+	}
+
+	return v[k];
+}
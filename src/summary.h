@@ -0,0 +1,96 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Compact loudness summary of a track (or part of one): the energies of
+ * all 400 ms gating blocks and 3 s short-term blocks above the absolute
+ * gate, plus per-channel peaks. Summaries of consecutive parts can be
+ * merged, and integrated loudness and loudness range are computed from
+ * them exactly the way libebur128 does it.
+ *
+ * With SUMMARY_HISTOGRAM, blocks are only counted in 0.1 LU wide bins from
+ * -70 to +30 LUFS (like EBUR128_MODE_HISTOGRAM), so a summary has the same
+ * size however long the track is, at the cost of a small quantisation
+ * error (at most 0.05 LU per block).
+ */
+#define SUMMARY_HISTOGRAM 1
+
+#define SUMMARY_BINS 1000
+
+typedef struct {
+	double        *energies;
+	size_t         size;       // number of blocks, in both modes
+	size_t         alloc;
+
+	unsigned long *hist;       // SUMMARY_BINS block counts, or NULL
+
+	double         max;        // energy of the loudest block (exact)
+} summary_blocks;
+
+typedef struct {
+	unsigned        channels;
+
+	summary_blocks  gating;       // 400 ms blocks, 100 ms apart
+	summary_blocks  shortterm;    // 3 s blocks, 1 s apart (for LRA)
+
+	double         *sample_peak;
+	double         *true_peak;
+} summary;
+
+void summary_init(summary *s, unsigned channels, int flags);
+void summary_free(summary *s);
+
+void summary_blocks_add(summary_blocks *b, double energy);
+
+void summary_shrink(summary *s);
+void summary_drop_blocks(summary *s);
+size_t summary_size(const summary *s);
+
+void summary_add_gating(summary *s, double energy);
+void summary_add_shortterm(summary *s, double energy);
+void summary_add_peak(summary *s, unsigned ch,
+                      double sample_peak, double true_peak);
+
+void summary_merge(summary *dst, const summary *src);
+
+double summary_energy(double loudness);
+double summary_loudness(double energy);
+
+void summary_loudness_global(summary **s, size_t nb, double *out);
+void summary_loudness_range(summary **s, size_t nb, double *out);
+double summary_peak(const summary *s);
+
+#ifdef __cplusplus
+}
+#endif
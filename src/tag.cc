@@ -116,6 +116,9 @@ static const char *RG_STRING_LOWER[] = {
     "replaygain_reference_loudness"
 };
 
+// Peaks and ranges are only written if the analysis profile measured them
+// (scan -> measured). Old tags are removed anyway, so none go stale.
+
 // this is where we store the RG tags in MP4/M4A files
 static const char *RG_ATOM = "----:com.apple.iTunes:";
 
@@ -178,16 +181,20 @@ bool tag_write_mp3(scan_result *scan, bool do_album, char mode, char *unit,
   snprintf(value, sizeof(value), "%.2f %s", scan -> track_gain, unit);
   tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_GAIN]), value);
 
-  snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
-  tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_PEAK]), value);
+  if (scan -> measured & SCAN_PEAKS) {
+    snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
+    tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_PEAK]), value);
+  }
 
   // Only write album tags if in album mode (would be zero otherwise)
   if (do_album) {
     snprintf(value, sizeof(value), "%.2f %s", scan -> album_gain, unit);
     tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_GAIN]), value);
 
-    snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
-    tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_PEAK]), value);
+    if (scan -> measured & SCAN_PEAKS) {
+      snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
+      tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_PEAK]), value);
+    }
   }
 
   // extra tags mode -s e or -s l
@@ -195,12 +202,14 @@ bool tag_write_mp3(scan_result *scan, bool do_album, char mode, char *unit,
     snprintf(value, sizeof(value), "%.2f LUFS", scan -> loudness_reference);
     tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_REFERENCE_LOUDNESS]), value);
 
-    snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
-    tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_RANGE]), value);
+    if (scan -> measured & SCAN_RANGE) {
+      snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
+      tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_RANGE]), value);
 
-    if (do_album) {
-      snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
-      tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_RANGE]), value);
+      if (do_album) {
+        snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
+        tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_RANGE]), value);
+      }
     }
   }
 
@@ -261,16 +270,20 @@ bool tag_write_flac(scan_result *scan, bool do_album, char mode, char *unit) {
   snprintf(value, sizeof(value), "%.2f %s", scan -> track_gain, unit);
   tag -> addField(RG_STRING_UPPER[RG_TRACK_GAIN], value);
 
-  snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
-  tag -> addField(RG_STRING_UPPER[RG_TRACK_PEAK], value);
+  if (scan -> measured & SCAN_PEAKS) {
+    snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
+    tag -> addField(RG_STRING_UPPER[RG_TRACK_PEAK], value);
+  }
 
   // Only write album tags if in album mode (would be zero otherwise)
   if (do_album) {
     snprintf(value, sizeof(value), "%.2f %s", scan -> album_gain, unit);
     tag -> addField(RG_STRING_UPPER[RG_ALBUM_GAIN], value);
 
-    snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
-    tag -> addField(RG_STRING_UPPER[RG_ALBUM_PEAK], value);
+    if (scan -> measured & SCAN_PEAKS) {
+      snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
+      tag -> addField(RG_STRING_UPPER[RG_ALBUM_PEAK], value);
+    }
   }
 
   // extra tags mode -s e or -s l
@@ -278,12 +291,14 @@ bool tag_write_flac(scan_result *scan, bool do_album, char mode, char *unit) {
     snprintf(value, sizeof(value), "%.2f LUFS", scan -> loudness_reference);
     tag -> addField(RG_STRING_UPPER[RG_REFERENCE_LOUDNESS], value);
 
-    snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
-    tag -> addField(RG_STRING_UPPER[RG_TRACK_RANGE], value);
+    if (scan -> measured & SCAN_RANGE) {
+      snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
+      tag -> addField(RG_STRING_UPPER[RG_TRACK_RANGE], value);
 
-    if (do_album) {
-      snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
-      tag -> addField(RG_STRING_UPPER[RG_ALBUM_RANGE], value);
+      if (do_album) {
+        snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
+        tag -> addField(RG_STRING_UPPER[RG_ALBUM_RANGE], value);
+      }
     }
   }
 
@@ -323,16 +338,20 @@ void tag_make_ogg(scan_result *scan, bool do_album, char mode, char *unit,
   snprintf(value, sizeof(value), "%.2f %s", scan -> track_gain, unit);
   tag -> addField(RG_STRING_UPPER[RG_TRACK_GAIN], value);
 
-  snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
-  tag -> addField(RG_STRING_UPPER[RG_TRACK_PEAK], value);
+  if (scan -> measured & SCAN_PEAKS) {
+    snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
+    tag -> addField(RG_STRING_UPPER[RG_TRACK_PEAK], value);
+  }
 
   // Only write album tags if in album mode (would be zero otherwise)
   if (do_album) {
     snprintf(value, sizeof(value), "%.2f %s", scan -> album_gain, unit);
     tag -> addField(RG_STRING_UPPER[RG_ALBUM_GAIN], value);
 
-    snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
-    tag -> addField(RG_STRING_UPPER[RG_ALBUM_PEAK], value);
+    if (scan -> measured & SCAN_PEAKS) {
+      snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
+      tag -> addField(RG_STRING_UPPER[RG_ALBUM_PEAK], value);
+    }
   }
 
   // extra tags mode -s e or -s l
@@ -340,12 +359,14 @@ void tag_make_ogg(scan_result *scan, bool do_album, char mode, char *unit,
     snprintf(value, sizeof(value), "%.2f LUFS", scan -> loudness_reference);
     tag -> addField(RG_STRING_UPPER[RG_REFERENCE_LOUDNESS], value);
 
-    snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
-    tag -> addField(RG_STRING_UPPER[RG_TRACK_RANGE], value);
+    if (scan -> measured & SCAN_RANGE) {
+      snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
+      tag -> addField(RG_STRING_UPPER[RG_TRACK_RANGE], value);
 
-    if (do_album) {
-      snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
-      tag -> addField(RG_STRING_UPPER[RG_ALBUM_RANGE], value);
+      if (do_album) {
+        snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
+        tag -> addField(RG_STRING_UPPER[RG_ALBUM_RANGE], value);
+      }
     }
   }
 }
@@ -548,16 +569,20 @@ bool tag_write_mp4(scan_result *scan, bool do_album, char mode, char *unit,
   snprintf(value, sizeof(value), "%.2f %s", scan -> track_gain, unit);
   tag -> setItem(tagname(RG_STRING[RG_TRACK_GAIN]), TagLib::StringList(value));
 
-  snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
-  tag -> setItem(tagname(RG_STRING[RG_TRACK_PEAK]), TagLib::StringList(value));
+  if (scan -> measured & SCAN_PEAKS) {
+    snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
+    tag -> setItem(tagname(RG_STRING[RG_TRACK_PEAK]), TagLib::StringList(value));
+  }
 
   // Only write album tags if in album mode (would be zero otherwise)
   if (do_album) {
     snprintf(value, sizeof(value), "%.2f %s", scan -> album_gain, unit);
     tag -> setItem(tagname(RG_STRING[RG_ALBUM_GAIN]), TagLib::StringList(value));
 
-    snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
-    tag -> setItem(tagname(RG_STRING[RG_ALBUM_PEAK]), TagLib::StringList(value));
+    if (scan -> measured & SCAN_PEAKS) {
+      snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
+      tag -> setItem(tagname(RG_STRING[RG_ALBUM_PEAK]), TagLib::StringList(value));
+    }
   }
 
   // extra tags mode -s e or -s l
@@ -565,12 +590,14 @@ bool tag_write_mp4(scan_result *scan, bool do_album, char mode, char *unit,
     snprintf(value, sizeof(value), "%.2f LUFS", scan -> loudness_reference);
     tag -> setItem(tagname(RG_STRING[RG_REFERENCE_LOUDNESS]), TagLib::StringList(value));
 
-    snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
-    tag -> setItem(tagname(RG_STRING[RG_TRACK_RANGE]), TagLib::StringList(value));
+    if (scan -> measured & SCAN_RANGE) {
+      snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
+      tag -> setItem(tagname(RG_STRING[RG_TRACK_RANGE]), TagLib::StringList(value));
 
-    if (do_album) {
-      snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
-      tag -> setItem(tagname(RG_STRING[RG_ALBUM_RANGE]), TagLib::StringList(value));
+      if (do_album) {
+        snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
+        tag -> setItem(tagname(RG_STRING[RG_ALBUM_RANGE]), TagLib::StringList(value));
+      }
     }
   }
 
@@ -626,16 +653,20 @@ bool tag_write_asf(scan_result *scan, bool do_album, char mode, char *unit,
   snprintf(value, sizeof(value), "%.2f %s", scan -> track_gain, unit);
   tag -> setAttribute(RG_STRING[RG_TRACK_GAIN], TagLib::String(value));
 
-  snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
-  tag -> setAttribute(RG_STRING[RG_TRACK_PEAK], TagLib::String(value));
+  if (scan -> measured & SCAN_PEAKS) {
+    snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
+    tag -> setAttribute(RG_STRING[RG_TRACK_PEAK], TagLib::String(value));
+  }
 
   // Only write album tags if in album mode (would be zero otherwise)
   if (do_album) {
     snprintf(value, sizeof(value), "%.2f %s", scan -> album_gain, unit);
     tag -> setAttribute(RG_STRING[RG_ALBUM_GAIN], TagLib::String(value));
 
-    snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
-    tag -> setAttribute(RG_STRING[RG_ALBUM_PEAK], TagLib::String(value));
+    if (scan -> measured & SCAN_PEAKS) {
+      snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
+      tag -> setAttribute(RG_STRING[RG_ALBUM_PEAK], TagLib::String(value));
+    }
   }
 
   // extra tags mode -s e or -s l
@@ -643,12 +674,14 @@ bool tag_write_asf(scan_result *scan, bool do_album, char mode, char *unit,
     snprintf(value, sizeof(value), "%.2f LUFS", scan -> loudness_reference);
     tag -> setAttribute(RG_STRING[RG_REFERENCE_LOUDNESS], TagLib::String(value));
 
-    snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
-    tag -> setAttribute(RG_STRING[RG_TRACK_RANGE], TagLib::String(value));
+    if (scan -> measured & SCAN_RANGE) {
+      snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
+      tag -> setAttribute(RG_STRING[RG_TRACK_RANGE], TagLib::String(value));
 
-    if (do_album) {
-      snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
-      tag -> setAttribute(RG_STRING[RG_ALBUM_RANGE], TagLib::String(value));
+      if (do_album) {
+        snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
+        tag -> setAttribute(RG_STRING[RG_ALBUM_RANGE], TagLib::String(value));
+      }
     }
   }
 
@@ -711,16 +744,20 @@ bool tag_write_wav(scan_result *scan, bool do_album, char mode, char *unit,
   snprintf(value, sizeof(value), "%.2f %s", scan -> track_gain, unit);
   tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_GAIN]), value);
 
-  snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
-  tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_PEAK]), value);
+  if (scan -> measured & SCAN_PEAKS) {
+    snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
+    tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_PEAK]), value);
+  }
 
   // Only write album tags if in album mode (would be zero otherwise)
   if (do_album) {
     snprintf(value, sizeof(value), "%.2f %s", scan -> album_gain, unit);
     tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_GAIN]), value);
 
-    snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
-    tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_PEAK]), value);
+    if (scan -> measured & SCAN_PEAKS) {
+      snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
+      tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_PEAK]), value);
+    }
   }
 
   // extra tags mode -s e or -s l
@@ -728,12 +765,14 @@ bool tag_write_wav(scan_result *scan, bool do_album, char mode, char *unit,
     snprintf(value, sizeof(value), "%.2f LUFS", scan -> loudness_reference);
     tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_REFERENCE_LOUDNESS]), value);
 
-    snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
-    tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_RANGE]), value);
+    if (scan -> measured & SCAN_RANGE) {
+      snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
+      tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_RANGE]), value);
 
-    if (do_album) {
-      snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
-      tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_RANGE]), value);
+      if (do_album) {
+        snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
+        tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_RANGE]), value);
+      }
     }
   }
 
@@ -812,16 +851,20 @@ bool tag_write_aiff(scan_result *scan, bool do_album, char mode, char *unit,
   snprintf(value, sizeof(value), "%.2f %s", scan -> track_gain, unit);
   tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_GAIN]), value);
 
-  snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
-  tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_PEAK]), value);
+  if (scan -> measured & SCAN_PEAKS) {
+    snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
+    tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_PEAK]), value);
+  }
 
   // Only write album tags if in album mode (would be zero otherwise)
   if (do_album) {
     snprintf(value, sizeof(value), "%.2f %s", scan -> album_gain, unit);
     tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_GAIN]), value);
 
-    snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
-    tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_PEAK]), value);
+    if (scan -> measured & SCAN_PEAKS) {
+      snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
+      tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_PEAK]), value);
+    }
   }
 
   // extra tags mode -s e or -s l
@@ -829,12 +872,14 @@ bool tag_write_aiff(scan_result *scan, bool do_album, char mode, char *unit,
     snprintf(value, sizeof(value), "%.2f LUFS", scan -> loudness_reference);
     tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_REFERENCE_LOUDNESS]), value);
 
-    snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
-    tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_RANGE]), value);
+    if (scan -> measured & SCAN_RANGE) {
+      snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
+      tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_TRACK_RANGE]), value);
 
-    if (do_album) {
-      snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
-      tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_RANGE]), value);
+      if (do_album) {
+        snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
+        tag_add_txxx(tag, const_cast<char *>(RG_STRING[RG_ALBUM_RANGE]), value);
+      }
     }
   }
 
@@ -899,16 +944,20 @@ bool tag_write_wavpack(scan_result *scan, bool do_album, char mode, char *unit,
   snprintf(value, sizeof(value), "%.2f %s", scan -> track_gain, unit);
   tag -> addValue(RG_STRING[RG_TRACK_GAIN], TagLib::String(value), true);
 
-  snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
-  tag -> addValue(RG_STRING[RG_TRACK_PEAK], TagLib::String(value), true);
+  if (scan -> measured & SCAN_PEAKS) {
+    snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
+    tag -> addValue(RG_STRING[RG_TRACK_PEAK], TagLib::String(value), true);
+  }
 
   // Only write album tags if in album mode (would be zero otherwise)
   if (do_album) {
     snprintf(value, sizeof(value), "%.2f %s", scan -> album_gain, unit);
     tag -> addValue(RG_STRING[RG_ALBUM_GAIN], TagLib::String(value), true);
 
-    snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
-    tag -> addValue(RG_STRING[RG_ALBUM_PEAK], TagLib::String(value), true);
+    if (scan -> measured & SCAN_PEAKS) {
+      snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
+      tag -> addValue(RG_STRING[RG_ALBUM_PEAK], TagLib::String(value), true);
+    }
   }
 
   // extra tags mode -s e or -s l
@@ -916,12 +965,14 @@ bool tag_write_wavpack(scan_result *scan, bool do_album, char mode, char *unit,
     snprintf(value, sizeof(value), "%.2f LUFS", scan -> loudness_reference);
     tag -> addValue(RG_STRING[RG_REFERENCE_LOUDNESS], TagLib::String(value), true);
 
-    snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
-    tag -> addValue(RG_STRING[RG_TRACK_RANGE], TagLib::String(value), true);
+    if (scan -> measured & SCAN_RANGE) {
+      snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
+      tag -> addValue(RG_STRING[RG_TRACK_RANGE], TagLib::String(value), true);
 
-    if (do_album) {
-      snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
-      tag -> addValue(RG_STRING[RG_ALBUM_RANGE], TagLib::String(value), true);
+      if (do_album) {
+        snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
+        tag -> addValue(RG_STRING[RG_ALBUM_RANGE], TagLib::String(value), true);
+      }
     }
   }
 
@@ -983,16 +1034,20 @@ bool tag_write_ape(scan_result *scan, bool do_album, char mode, char *unit,
   snprintf(value, sizeof(value), "%.2f %s", scan -> track_gain, unit);
   tag -> addValue(RG_STRING[RG_TRACK_GAIN], TagLib::String(value), true);
 
-  snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
-  tag -> addValue(RG_STRING[RG_TRACK_PEAK], TagLib::String(value), true);
+  if (scan -> measured & SCAN_PEAKS) {
+    snprintf(value, sizeof(value), "%.6f", scan -> track_peak);
+    tag -> addValue(RG_STRING[RG_TRACK_PEAK], TagLib::String(value), true);
+  }
 
   // Only write album tags if in album mode (would be zero otherwise)
   if (do_album) {
     snprintf(value, sizeof(value), "%.2f %s", scan -> album_gain, unit);
     tag -> addValue(RG_STRING[RG_ALBUM_GAIN], TagLib::String(value), true);
 
-    snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
-    tag -> addValue(RG_STRING[RG_ALBUM_PEAK], TagLib::String(value), true);
+    if (scan -> measured & SCAN_PEAKS) {
+      snprintf(value, sizeof(value), "%.6f", scan -> album_peak);
+      tag -> addValue(RG_STRING[RG_ALBUM_PEAK], TagLib::String(value), true);
+    }
   }
 
   // extra tags mode -s e or -s l
@@ -1000,12 +1055,14 @@ bool tag_write_ape(scan_result *scan, bool do_album, char mode, char *unit,
     snprintf(value, sizeof(value), "%.2f LUFS", scan -> loudness_reference);
     tag -> addValue(RG_STRING[RG_REFERENCE_LOUDNESS], TagLib::String(value), true);
 
-    snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
-    tag -> addValue(RG_STRING[RG_TRACK_RANGE], TagLib::String(value), true);
+    if (scan -> measured & SCAN_RANGE) {
+      snprintf(value, sizeof(value), "%.2f %s", scan -> track_loudness_range, unit);
+      tag -> addValue(RG_STRING[RG_TRACK_RANGE], TagLib::String(value), true);
 
-    if (do_album) {
-      snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
-      tag -> addValue(RG_STRING[RG_ALBUM_RANGE], TagLib::String(value), true);
+      if (do_album) {
+        snprintf(value, sizeof(value), "%.2f %s", scan -> album_loudness_range, unit);
+        tag -> addValue(RG_STRING[RG_ALBUM_RANGE], TagLib::String(value), true);
+      }
     }
   }
 
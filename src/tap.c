@@ -0,0 +1,108 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "summary.h"
+#include "tap.h"
+#include "meter.h"
+
+void tap_init(tap *t, meter *meter, summary *sum,
+              int64_t pos, int64_t from, int64_t to) {
+	t -> meter   = meter;
+	t -> sum     = sum;
+	t -> raw     = 0;
+	t -> hop     = (meter_samplerate(meter) + 5) / 10;
+	t -> pos     = pos;
+	t -> from    = from;
+	t -> to      = to;
+}
+
+void tap_add(tap *t, const tap_pcm *pcm, size_t offset, size_t nb) {
+	int flags = meter_flags(t -> meter);
+	int peaks = flags & (METER_SAMPLE_PEAK | METER_TRUE_PEAK);
+	unsigned ch;
+
+	while (nb > 0) {
+		// never feed across a 100 ms boundary
+		int64_t next = (t -> pos / t -> hop + 1) * t -> hop;
+		size_t n = (int64_t) nb < next - t -> pos ? nb : next - t -> pos;
+		int record;
+
+		// only peaks above what was recorded can change anything
+		for (ch = 0; peaks && ch < meter_channels(t -> meter); ch++) {
+			meter_set_floor(t -> meter, ch, t -> pos < t -> from ? HUGE_VAL :
+			                fmax(t -> sum -> sample_peak[ch],
+			                     t -> sum -> true_peak[ch]));
+		}
+
+		meter_add(t -> meter, pcm, offset, n);
+
+		if (peaks && t -> pos >= t -> from) {
+			for (ch = 0; ch < meter_channels(t -> meter); ch++) {
+				double sample_peak = 0.0, true_peak = 0.0;
+
+				meter_peaks(t -> meter, ch, &sample_peak, &true_peak);
+				summary_add_peak(t -> sum, ch, sample_peak, true_peak);
+			}
+		}
+
+		t -> pos += n;
+		offset   += n;
+		nb       -= n;
+
+		if (t -> pos % t -> hop != 0)
+			continue;
+
+		// a block ends here; is it one of ours?
+		record = t -> pos > t -> from && t -> pos <= t -> to;
+
+		if (record && t -> pos >= 4 * t -> hop) {
+			double energy = meter_momentary(t -> meter);
+
+			if (t -> raw)
+				summary_blocks_add(&t -> sum -> gating, energy);
+			else
+				summary_add_gating(t -> sum, energy);
+		}
+
+		if (record && (flags & METER_SHORTTERM) &&
+		    t -> pos >= 30 * t -> hop && t -> pos % (10 * t -> hop) == 0) {
+			double energy = meter_shortterm(t -> meter);
+
+			if (t -> raw)
+				summary_blocks_add(&t -> sum -> shortterm, energy);
+			else
+				summary_add_shortterm(t -> sum, energy);
+		}
+	}
+}
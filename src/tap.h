@@ -0,0 +1,73 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Interleaved samples in one of the formats libebur128 takes (and a meter). */
+enum { TAP_S16, TAP_S32, TAP_FLT, TAP_DBL };
+
+typedef struct {
+	int            type;
+	const uint8_t *data;
+	size_t         stride;      // bytes per sample frame (all channels)
+} tap_pcm;
+
+/*
+ * Records a stream into a summary instead of leaving everything inside
+ * the meter: the meter is fed in 100 ms steps, and after every step the
+ * momentary (400 ms) and, every second, the short-term (3 s) energy is
+ * read back, which are exactly the gating and LRA blocks libebur128 would
+ * have kept. Positions count frames from the start of
+ * the track, so a tap that starts in the middle of a track (after some
+ * pre-roll) records exactly the blocks of a full scan in [from, to).
+ *
+ * A raw tap keeps every block, without the absolute gate, so the blocks
+ * of single-channel taps can be added up to the blocks of the stream.
+ * Short-term blocks and peaks are only recorded if the meter measures them.
+ */
+typedef struct {
+	struct meter  *meter;
+	summary       *sum;
+	int            raw;
+	int64_t        hop;         // frames per 100 ms, as libebur128 counts
+	int64_t        pos;         // track position of the next frame
+	int64_t        from;        // first position that is recorded
+	int64_t        to;          // end of the recorded part
+} tap;
+
+void tap_init(tap *t, struct meter *meter, summary *sum,
+              int64_t pos, int64_t from, int64_t to);
+void tap_add(tap *t, const tap_pcm *pcm, size_t offset, size_t nb);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,376 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define TRUEPEAK_X86 1
+#include <immintrin.h>
+#endif
+
+#include "truepeak.h"
+#include "printf.h"
+
+#define TRUEPEAK_TAPS  49
+#define TRUEPEAK_MAX_FACTOR 4
+
+// inputs that are skipped or oversampled together
+#define TRUEPEAK_PART  256
+
+/*
+ * Polyphase filter of one rate class: phase f makes output sample f of
+ * every input sample, from the inputs index[f][t] samples back.
+ */
+typedef struct {
+	unsigned factor;
+	unsigned delay;             // inputs the filter spans
+	double   gain;              // bound of |output| / max |input|
+	unsigned count[TRUEPEAK_MAX_FACTOR];
+	unsigned index[TRUEPEAK_MAX_FACTOR][TRUEPEAK_TAPS];
+	double   coeff[TRUEPEAK_MAX_FACTOR][TRUEPEAK_TAPS];
+} truepeak_class;
+
+/*
+ * Raises *peak to the highest absolute output of nb inputs; in[-delay + 1]
+ * to in[-1] are the inputs before in[0].
+ */
+typedef void (*truepeak_fn)(const truepeak_class *cls, const double *in,
+                            size_t nb, double *peak);
+
+typedef struct {
+	const char *name;
+	truepeak_fn run;
+} truepeak_kernel_def;
+
+struct truepeak {
+	unsigned                   channels;
+	const truepeak_class      *cls;       // NULL: no oversampling
+	const truepeak_kernel_def *kernel;
+	size_t                     size;      // inputs per channel buffer
+	double                    *buf;       // history, then new inputs
+
+	unsigned long              nb_parts;
+	unsigned long              nb_oversampled;
+};
+
+static truepeak_class truepeak_4x;
+static truepeak_class truepeak_2x;
+static pthread_once_t truepeak_once = PTHREAD_ONCE_INIT;
+
+static void truepeak_init_classes(void);
+static void truepeak_init_class(truepeak_class *cls, unsigned factor);
+static const truepeak_kernel_def *truepeak_find(const char *name);
+static void truepeak_scalar(const truepeak_class *cls, const double *in,
+                            size_t nb, double *peak);
+
+truepeak *truepeak_new(unsigned channels, unsigned long samplerate,
+                       const char *kernel) {
+	truepeak *tp;
+
+	pthread_once(&truepeak_once, truepeak_init_classes);
+
+	tp = calloc(1, sizeof(truepeak));
+	if (tp == NULL)
+		fail_printf("OOM");
+
+	tp -> channels = channels;
+	tp -> kernel   = truepeak_find(kernel);
+
+	if (tp -> kernel == NULL)
+		fail_printf("True-peak kernel '%s' not supported", kernel);
+
+	if (samplerate < 96000)
+		tp -> cls = &truepeak_4x;
+	else if (samplerate < 192000)
+		tp -> cls = &truepeak_2x;
+
+	// nothing between the samples to look at
+	if (tp -> cls == NULL)
+		return tp;
+
+	// one 100 ms step at a time, see truepeak_add()
+	tp -> size = tp -> cls -> delay - 1 + (samplerate + 5) / 10;
+	tp -> buf  = calloc((size_t) channels * tp -> size, sizeof(double));
+	if (tp -> buf == NULL)
+		fail_printf("OOM");
+
+	return tp;
+}
+
+void truepeak_free(truepeak *tp) {
+	if (tp == NULL)
+		return;
+
+	free(tp -> buf);
+	free(tp);
+}
+
+const char *truepeak_kernel(const truepeak *tp) {
+	return tp -> kernel -> name;
+}
+
+/*
+ * Runs nb frames of x (channels interleaved, lanes values per frame)
+ * through the interpolator, and raises peak[ch] to the highest absolute
+ * oversampled value of every channel, where that is above floor[ch].
+ */
+void truepeak_add(truepeak *tp, const double *x, size_t lanes, size_t nb,
+                  const double *floor, double *peak) {
+	size_t hist, room, i, s;
+	unsigned ch;
+
+	if (tp -> cls == NULL)
+		return;
+
+	hist = tp -> cls -> delay - 1;
+	room = tp -> size - hist;
+
+	while (nb > 0) {
+		size_t n = nb < room ? nb : room;
+
+		for (ch = 0; ch < tp -> channels; ch++) {
+			double *buf = tp -> buf + ch * tp -> size;
+			float below;
+
+			// libebur128 oversamples single-precision samples
+			for (i = 0; i < n; i++)
+				buf[hist + i] = (float) x[i * lanes + ch];
+
+			for (s = 0; s < n; s += TRUEPEAK_PART) {
+				size_t len = n - s < TRUEPEAK_PART ? n - s : TRUEPEAK_PART;
+				double in = 0.0;
+
+				/* outputs are rounded to single precision, so what is skipped
+				 * must not even round above the limit */
+				below = (float) fmax(floor[ch], peak[ch]);
+				if (below > fmax(floor[ch], peak[ch]))
+					below = nextafterf(below, 0.0f);
+
+				// the part and the history its outputs look back on
+				for (i = s; i < s + hist + len; i++)
+					in = buf[i] > in ? buf[i] : (-buf[i] > in ? -buf[i] : in);
+
+				tp -> nb_parts++;
+
+				if (in * tp -> cls -> gain <= below)
+					continue;
+
+				tp -> kernel -> run(tp -> cls, buf + hist + s, len, &peak[ch]);
+				tp -> nb_oversampled++;
+			}
+
+			// libebur128 keeps single-precision outputs
+			peak[ch] = (float) peak[ch];
+
+			memmove(buf, buf + n, sizeof(double) * hist);
+		}
+
+		x  += n * lanes;
+		nb -= n;
+	}
+}
+
+void truepeak_stats(const truepeak *tp, unsigned long *parts,
+                    unsigned long *oversampled) {
+	*parts       = tp -> nb_parts;
+	*oversampled = tp -> nb_oversampled;
+}
+
+static void truepeak_init_classes(void) {
+	truepeak_init_class(&truepeak_4x, 4);
+	truepeak_init_class(&truepeak_2x, 2);
+}
+
+/* Hann-windowed sinc, zero coefficients left out (libebur128's interp_create). */
+static void truepeak_init_class(truepeak_class *cls, unsigned factor) {
+	unsigned j, f;
+
+	memset(cls, 0, sizeof(truepeak_class));
+
+	cls -> factor = factor;
+	cls -> delay  = (TRUEPEAK_TAPS + factor - 1) / factor;
+
+	for (j = 0; j < TRUEPEAK_TAPS; j++) {
+		double m = (double) j - (double) (TRUEPEAK_TAPS - 1) / 2.0;
+		double c = 1.0;
+
+		if (fabs(m) > 0.000001)
+			c = sin(m * M_PI / factor) / (m * M_PI / factor);
+
+		c *= 0.5 * (1.0 - cos(2.0 * M_PI * j / (TRUEPEAK_TAPS - 1)));
+
+		if (fabs(c) > 0.000001) {
+			unsigned phase = j % factor;
+
+			cls -> coeff[phase][cls -> count[phase]] = c;
+			cls -> index[phase][cls -> count[phase]] = j / factor;
+			cls -> count[phase]++;
+		}
+	}
+
+	for (f = 0; f < factor; f++) {
+		double sum = 0.0;
+		unsigned t;
+
+		for (t = 0; t < cls -> count[f]; t++)
+			sum += fabs(cls -> coeff[f][t]);
+
+		cls -> gain = fmax(cls -> gain, sum);
+	}
+
+	// room for the rounding of the sums
+	cls -> gain *= 1.000001;
+}
+
+/* One output sample; the reference for the vector kernels. */
+static inline double truepeak_dot(const truepeak_class *cls, unsigned f,
+                                  const double *in) {
+	double acc = 0.0;
+	unsigned t;
+
+	for (t = 0; t < cls -> count[f]; t++)
+		acc += in[-(int) cls -> index[f][t]] * cls -> coeff[f][t];
+
+	return acc;
+}
+
+static void truepeak_scalar(const truepeak_class *cls, const double *in,
+                            size_t nb, double *peak) {
+	double p = *peak;
+	unsigned f;
+	size_t n;
+
+	for (f = 0; f < cls -> factor; f++) {
+		for (n = 0; n < nb; n++)
+			p = fmax(p, fabs(truepeak_dot(cls, f, in + n)));
+	}
+
+	*peak = p;
+}
+
+#ifdef TRUEPEAK_X86
+
+/*
+ * W consecutive outputs of one phase at a time, two vectors per round so
+ * two accumulation chains are in flight. No FMA contraction, so the sums
+ * are those of truepeak_dot().
+ */
+#define TRUEPEAK_KERNEL(NAME, TARGET, W, VEC, PFX, ABS)                         \
+__attribute__((target(TARGET), optimize("fp-contract=off")))                \
+static void NAME(const truepeak_class *cls, const double *in,                 \
+                 size_t nb, double *peak) {                                   \
+	VEC p = PFX##_setzero_pd();                                                 \
+	double lanes[W], tail = *peak;                                              \
+	unsigned f, t, i;                                                           \
+	size_t n;                                                                   \
+                                                                              \
+	for (f = 0; f < cls -> factor; f++) {                                       \
+		const unsigned *index = cls -> index[f];                                  \
+		const double *coeff = cls -> coeff[f];                                    \
+                                                                              \
+		for (n = 0; n + 2 * W <= nb; n += 2 * W) {                                \
+			VEC acc0 = PFX##_setzero_pd(), acc1 = PFX##_setzero_pd();               \
+                                                                              \
+			for (t = 0; t < cls -> count[f]; t++) {                                 \
+				const double *src = in + n - index[t];                                \
+				VEC c = PFX##_set1_pd(coeff[t]);                                      \
+                                                                              \
+				acc0 = PFX##_add_pd(acc0, PFX##_mul_pd(PFX##_loadu_pd(src), c));      \
+				acc1 = PFX##_add_pd(acc1, PFX##_mul_pd(PFX##_loadu_pd(src + W), c));  \
+			}                                                                       \
+                                                                              \
+			p = PFX##_max_pd(p, ABS(acc0));                                         \
+			p = PFX##_max_pd(p, ABS(acc1));                                         \
+		}                                                                         \
+                                                                              \
+		for (; n < nb; n++)                                                       \
+			tail = fmax(tail, fabs(truepeak_dot(cls, f, in + n)));                  \
+	}                                                                           \
+                                                                              \
+	PFX##_storeu_pd(lanes, p);                                                  \
+	for (i = 0; i < W; i++)                                                     \
+		tail = fmax(tail, lanes[i]);                                              \
+                                                                              \
+	*peak = tail;                                                               \
+}
+
+#define TRUEPEAK_ABS128(X) _mm_andnot_pd(_mm_set1_pd(-0.0), X)
+#define TRUEPEAK_ABS256(X) _mm256_andnot_pd(_mm256_set1_pd(-0.0), X)
+#define TRUEPEAK_ABS512(X) _mm512_abs_pd(X)
+
+TRUEPEAK_KERNEL(truepeak_sse2,   "sse2",    2, __m128d, _mm,    TRUEPEAK_ABS128)
+TRUEPEAK_KERNEL(truepeak_avx2,   "avx2",    4, __m256d, _mm256, TRUEPEAK_ABS256)
+TRUEPEAK_KERNEL(truepeak_avx512, "avx512f", 8, __m512d, _mm512, TRUEPEAK_ABS512)
+
+#endif
+
+static const truepeak_kernel_def truepeak_kernels[] = {
+#ifdef TRUEPEAK_X86
+	{ "avx512", truepeak_avx512 },
+	{ "avx2",   truepeak_avx2   },
+	{ "sse2",   truepeak_sse2   },
+#endif
+	{ "scalar", truepeak_scalar },
+};
+
+#define TRUEPEAK_NB_KERNELS (sizeof(truepeak_kernels) / sizeof(truepeak_kernels[0]))
+
+static int truepeak_supported(const truepeak_kernel_def *kern) {
+#ifdef TRUEPEAK_X86
+	if (kern -> run == truepeak_avx512)
+		return __builtin_cpu_supports("avx512f");
+
+	if (kern -> run == truepeak_avx2)
+		return __builtin_cpu_supports("avx2");
+
+	if (kern -> run == truepeak_sse2)
+		return __builtin_cpu_supports("sse2");
+#endif
+
+	return 1;
+}
+
+/* The kernel called name (the widest supported one for NULL). */
+static const truepeak_kernel_def *truepeak_find(const char *name) {
+	size_t i;
+
+	for (i = 0; i < TRUEPEAK_NB_KERNELS; i++) {
+		if (!truepeak_supported(&truepeak_kernels[i]))
+			continue;
+
+		if (name == NULL || strcmp(truepeak_kernels[i].name, name) == 0)
+			return &truepeak_kernels[i];
+	}
+
+	return NULL;
+}
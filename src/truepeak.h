@@ -0,0 +1,70 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * True-peak detection: the signal is oversampled (4x below 96 kHz, 2x
+ * below 192 kHz, not at all above) with the same 49-tap windowed-sinc
+ * interpolator libebur128 uses, from single-precision samples like
+ * libebur128, and the highest absolute oversampled value is the true peak.
+ *
+ * The interpolator is polyphase, with one coefficient table per rate
+ * class, and runs on the same kernels as K-weighting ("scalar", "sse2",
+ * "avx2", "avx512"; NULL picks the widest this CPU has). Vectors hold
+ * consecutive output samples of one channel, so mono and stereo use all
+ * lanes, and every kernel sums the taps in the same order, so all kernels
+ * give the same bits (tests/truepeak_test.c holds them to within 0.05 dB
+ * of libebur128's true peaks).
+ *
+ * Input is taken in short parts, and a part is only oversampled if it can
+ * beat the caller's floor: no output can be louder than the loudest input
+ * it depends on times the sum of the absolute coefficients of a phase.
+ * Peaks at or below the floor are not looked for, so the caller's maximum
+ * stays exactly what it would have been.
+ */
+typedef struct truepeak truepeak;
+
+truepeak *truepeak_new(unsigned channels, unsigned long samplerate,
+                       const char *kernel);
+void truepeak_free(truepeak *tp);
+
+const char *truepeak_kernel(const truepeak *tp);
+
+void truepeak_add(truepeak *tp, const double *x, size_t lanes, size_t nb,
+                  const double *floor, double *peak);
+void truepeak_stats(const truepeak *tp, unsigned long *parts,
+                    unsigned long *oversampled);
+
+#ifdef __cplusplus
+}
+#endif
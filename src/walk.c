@@ -0,0 +1,272 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <dirent.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "walk.h"
+#include "printf.h"
+
+/* The folders on the way down, to notice loops through followed links. */
+typedef struct walk_parent {
+	dev_t                      dev;
+	ino_t                      ino;
+	const struct walk_parent  *up;
+} walk_parent;
+
+static int walk_dir(const char *dir, const char *const *exts,
+                    const char *const *excludes, int follow_links,
+                    const walk_parent *up, walk_result *res);
+static const char *walk_match_ext(const char *name, const char *const *exts);
+static int walk_excluded(const char *name, const char *const *excludes);
+static void walk_add(walk_result *res, const char *dir, const char *ext,
+                     char *file);
+static char *walk_join(const char *dir, const char *name);
+static int walk_cmp(const void *a, const void *b);
+
+int walk_tree(const char *root, const char *const *exts,
+              const char *const *excludes, int follow_links,
+              walk_result *res) {
+	return walk_dir(root, exts, excludes, follow_links, NULL, res);
+}
+
+void walk_free(walk_result *res) {
+	unsigned i, j;
+
+	for (i = 0; i < res -> nb_groups; i++) {
+		for (j = 0; j < res -> groups[i].nb_files; j++)
+			free(res -> groups[i].files[j]);
+
+		free(res -> groups[i].files);
+		free(res -> groups[i].dir);
+	}
+
+	free(res -> groups);
+	memset(res, 0, sizeof(walk_result));
+}
+
+static int walk_dir(const char *dir, const char *const *exts,
+                    const char *const *excludes, int follow_links,
+                    const walk_parent *up, walk_result *res) {
+	const walk_parent *p;
+	walk_parent self;
+	struct dirent *entry;
+	struct stat st;
+	char **names = NULL;
+	size_t i, nb_names = 0, alloc = 0;
+	DIR *d;
+
+	if (stat(dir, &st) < 0)
+		return -1;
+
+	for (p = up; p != NULL; p = p -> up) {
+		if (p -> dev == st.st_dev && p -> ino == st.st_ino) {
+			warn_printf("Skipping folder loop at %s", dir);
+			return 0;
+		}
+	}
+
+	self.dev = st.st_dev;
+	self.ino = st.st_ino;
+	self.up  = up;
+
+	d = opendir(dir);
+	if (d == NULL)
+		return -1;
+
+	while ((entry = readdir(d)) != NULL) {
+		if (!strcmp(entry -> d_name, ".") || !strcmp(entry -> d_name, ".."))
+			continue;
+
+		if (nb_names == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			names = realloc(names, sizeof(char *) * alloc);
+			if (names == NULL)
+				fail_printf("OOM");
+		}
+
+		names[nb_names] = strdup(entry -> d_name);
+		if (names[nb_names] == NULL)
+			fail_printf("OOM");
+
+		nb_names++;
+	}
+
+	closedir(d);
+
+	qsort(names, nb_names, sizeof(char *), walk_cmp);
+
+	// files of this folder first, then its subfolders (top down)
+	for (i = 0; i < nb_names; i++) {
+		const char *ext;
+		char *path = walk_join(dir, names[i]);
+
+		if (stat(path, &st) < 0 || !(S_ISREG(st.st_mode) || S_ISDIR(st.st_mode))) {
+			free(path);
+			free(names[i]);
+			names[i] = NULL;
+			continue;
+		}
+
+		if (S_ISDIR(st.st_mode)) {
+			// keep the full path, to descend later
+			free(names[i]);
+			names[i] = path;
+			continue;
+		}
+
+		ext = walk_match_ext(names[i], exts);
+
+		if (ext != NULL)
+			walk_add(res, dir, ext, path);
+		else
+			free(path);
+
+		free(names[i]);
+		names[i] = NULL;
+	}
+
+	for (i = 0; i < nb_names; i++) {
+		const char *path = names[i];
+		struct stat lst;
+
+		if (path == NULL)
+			continue;
+
+		if (walk_excluded(strrchr(path, '/') + 1, excludes)) {
+			ok_printf("Excluding %s", path);
+			res -> nb_excluded++;
+		} else if (follow_links ||
+		           (lstat(path, &lst) == 0 && !S_ISLNK(lst.st_mode))) {
+			if (walk_dir(path, exts, excludes, follow_links, &self, res) < 0)
+				warn_printf("Could not read folder %s", path);
+		}
+
+		free(names[i]);
+	}
+
+	free(names);
+
+	return 0;
+}
+
+static const char *walk_match_ext(const char *name, const char *const *exts) {
+	const char *dot = strrchr(name, '.');
+
+	// ".flac" is a hidden file without extension, not a FLAC file
+	if (dot == NULL || dot == name)
+		return NULL;
+
+	for (; *exts != NULL; exts++) {
+		if (!strcasecmp(dot, *exts))
+			return *exts;
+	}
+
+	return NULL;
+}
+
+static int walk_excluded(const char *name, const char *const *excludes) {
+	for (; *excludes != NULL; excludes++) {
+		if (fnmatch(*excludes, name, 0) == 0)
+			return 1;
+	}
+
+	return 0;
+}
+
+static void walk_add(walk_result *res, const char *dir, const char *ext,
+                     char *file) {
+	walk_group *g = NULL;
+	unsigned i;
+
+	// groups of the current folder are always the last ones
+	for (i = res -> nb_groups; i > 0; i--) {
+		walk_group *cur = &res -> groups[i - 1];
+
+		if (strcmp(cur -> dir, dir))
+			break;
+
+		if (cur -> ext == ext) {
+			g = cur;
+			break;
+		}
+	}
+
+	if (g == NULL) {
+		if (res -> nb_groups == res -> alloc) {
+			res -> alloc = res -> alloc ? res -> alloc * 2 : 64;
+			res -> groups = realloc(res -> groups,
+			                        sizeof(walk_group) * res -> alloc);
+			if (res -> groups == NULL)
+				fail_printf("OOM");
+		}
+
+		g = &res -> groups[res -> nb_groups++];
+		memset(g, 0, sizeof(walk_group));
+
+		g -> dir = strdup(dir);
+		g -> ext = ext;
+		if (g -> dir == NULL)
+			fail_printf("OOM");
+	}
+
+	if (g -> nb_files == g -> alloc) {
+		g -> alloc = g -> alloc ? g -> alloc * 2 : 16;
+		g -> files = realloc(g -> files, sizeof(char *) * g -> alloc);
+		if (g -> files == NULL)
+			fail_printf("OOM");
+	}
+
+	g -> files[g -> nb_files++] = file;
+	res -> nb_files++;
+}
+
+static char *walk_join(const char *dir, const char *name) {
+	size_t len = strlen(dir);
+	char *path = malloc(len + strlen(name) + 2);
+	if (path == NULL)
+		fail_printf("OOM");
+
+	strcpy(path, dir);
+	if (len == 0 || dir[len - 1] != '/')
+		strcat(path, "/");
+	strcat(path, name);
+
+	return path;
+}
+
+static int walk_cmp(const void *a, const void *b) {
+	return strcmp(*(char * const *) a, *(char * const *) b);
+}
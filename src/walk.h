@@ -0,0 +1,68 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Audio files of one type in one folder; the recursive mode (-R) treats
+ * every group as an album. Files are full paths, sorted by name. */
+typedef struct {
+	char        *dir;
+	const char  *ext;       // points into the extension list
+	char       **files;
+	unsigned     nb_files;
+	unsigned     alloc;
+} walk_group;
+
+typedef struct {
+	walk_group  *groups;
+	unsigned     nb_groups;
+	unsigned     alloc;
+
+	unsigned     nb_files;
+	unsigned     nb_excluded; // folders skipped because of an exclude glob
+} walk_result;
+
+/*
+ * Walk the folder tree below root (top down, in name order) and collect
+ * the files whose extension is in exts (lowercase, with the dot; NULL
+ * terminated). Folders whose name matches one of the excludes globs are
+ * skipped; symbolic links to folders are only followed on request.
+ * Returns non-zero if root could not be read.
+ */
+int walk_tree(const char *root, const char *const *exts,
+              const char *const *excludes, int follow_links,
+              walk_result *res);
+void walk_free(walk_result *res);
+
+#ifdef __cplusplus
+}
+#endif
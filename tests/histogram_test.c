@@ -0,0 +1,148 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures what -H costs: synthetic tracks are tapped into an exact and a
+ * histogram summary at once, and integrated loudness and loudness range
+ * of the two are compared. The largest differences are printed (the man
+ * page quotes them) and must stay within what 0.1 LU wide bins allow.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "summary.h"
+#include "tap.h"
+#include "meter.h"
+
+#define TEST_TRACKS   50
+#define TEST_RATE     48000
+#define TEST_CHANNELS 2
+
+#define TEST_INTEGRATED 0.05
+#define TEST_RANGE      0.1
+
+static uint32_t test_seed = 1;
+
+static double test_random(void) {
+	test_seed = test_seed * 1664525 + 1013904223;
+	return test_seed / 4294967296.0;
+}
+
+/*
+ * Noise whose level wanders between -50 and -8 dBFS from one second to
+ * the next, with a pause now and then; tracks are 30 s to 10 min long.
+ */
+static double *test_signal(size_t *nb) {
+	double level = -20.0, gain = 0.0;
+	size_t i;
+	double *x;
+
+	*nb = (size_t) (30 + test_random() * 570) * TEST_RATE;
+
+	x = malloc(*nb * TEST_CHANNELS * sizeof(double));
+	if (x == NULL) {
+		fprintf(stderr, "OOM\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < *nb * TEST_CHANNELS; i++) {
+		if (i % (TEST_RATE * TEST_CHANNELS) == 0) {
+			level = fmin(-8.0, fmax(-50.0, level + 8.0 * (test_random() - 0.5)));
+			gain  = test_random() < 0.05 ? 0.0 : pow(10.0, level / 20.0);
+		}
+
+		x[i] = gain * (2.0 * test_random() - 1.0);
+	}
+
+	return x;
+}
+
+static void test_measure(const double *x, size_t nb, int flags,
+                         double *integrated, double *range) {
+	summary sum, *sums = &sum;
+	tap_pcm pcm;
+	meter *m;
+	tap t;
+
+	m = meter_new(TEST_CHANNELS, TEST_RATE, "auto", METER_SHORTTERM);
+
+	summary_init(&sum, TEST_CHANNELS, flags);
+	tap_init(&t, m, &sum, 0, 0, nb);
+
+	pcm.type   = TAP_DBL;
+	pcm.data   = (const uint8_t *) x;
+	pcm.stride = TEST_CHANNELS * sizeof(double);
+
+	tap_add(&t, &pcm, 0, nb);
+
+	summary_loudness_global(&sums, 1, integrated);
+	summary_loudness_range(&sums, 1, range);
+
+	summary_free(&sum);
+	meter_free(m);
+}
+
+int main(void) {
+	double max_integrated = 0.0, max_range = 0.0;
+	double sum_integrated = 0.0, sum_range = 0.0;
+	int i;
+
+	for (i = 0; i < TEST_TRACKS; i++) {
+		double exact_i, exact_lra, hist_i, hist_lra;
+		size_t nb;
+		double *x = test_signal(&nb);
+
+		test_measure(x, nb, 0, &exact_i, &exact_lra);
+		test_measure(x, nb, SUMMARY_HISTOGRAM, &hist_i, &hist_lra);
+
+		printf("track %2d, %3zu s: I %.4f LUFS (-H %+.4f), "
+		       "LRA %.4f LU (-H %+.4f)\n", i + 1, nb / TEST_RATE,
+		       exact_i, hist_i - exact_i, exact_lra, hist_lra - exact_lra);
+
+		max_integrated  = fmax(max_integrated, fabs(hist_i - exact_i));
+		max_range       = fmax(max_range, fabs(hist_lra - exact_lra));
+		sum_integrated += fabs(hist_i - exact_i);
+		sum_range      += fabs(hist_lra - exact_lra);
+
+		free(x);
+	}
+
+	printf("-H differences: integrated loudness %.4f LU at most "
+	       "(%.4f on average), loudness range %.4f LU at most (%.4f)\n",
+	       max_integrated, sum_integrated / TEST_TRACKS,
+	       max_range, sum_range / TEST_TRACKS);
+
+	return max_integrated <= TEST_INTEGRATED && max_range <= TEST_RANGE ?
+	       EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,228 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Meters synthetic tracks with every loudness engine and kernel this CPU
+ * has, and compares integrated loudness, loudness range and the loudest
+ * momentary and short-term blocks with what libebur128 itself reports.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include <ebur128.h>
+
+#include "summary.h"
+#include "tap.h"
+#include "meter.h"
+
+#define TEST_SECONDS 20
+#define TEST_LU      0.01
+
+typedef struct {
+	double integrated;
+	double range;
+	double momentary;
+	double shortterm;
+} test_result;
+
+static const unsigned test_channels[] = { 1, 2, 6 };
+
+static const unsigned long test_rates[] = { 44100, 48000, 96000 };
+
+static const char *test_engines[] = {
+	"ebur128", "auto", "scalar", "sse2", "avx2", "avx512"
+};
+
+#define NB(a) (sizeof(a) / sizeof(a[0]))
+
+/*
+ * A tone per channel, 2 s steps between -36 and -6 dBFS and a second of
+ * silence in every 10, so both gates and the loudness range have work.
+ */
+static double *test_signal(unsigned channels, unsigned long rate, size_t nb) {
+	double *x;
+	size_t i;
+	unsigned ch;
+
+	x = malloc(nb * channels * sizeof(double));
+	if (x == NULL) {
+		fprintf(stderr, "OOM\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < nb; i++) {
+		unsigned step = i / (2 * rate);
+		double gain = pow(10.0, (-36.0 + 6.0 * (step * 7 % 6)) / 20.0);
+
+		if (i % (10 * rate) >= 9 * rate)
+			gain = 0.0;
+
+		for (ch = 0; ch < channels; ch++) {
+			double f = 100.0 * (ch + 1) + 37.0 * step;
+
+			x[i * channels + ch] = gain *
+				sin(2.0 * M_PI * f * i / rate + 0.5 * ch);
+		}
+	}
+
+	return x;
+}
+
+/* libebur128 alone, read back the way a tap reads a meter. */
+static void test_reference(const double *x, unsigned channels,
+                           unsigned long rate, size_t nb, test_result *r) {
+	ebur128_state *st;
+	size_t hop = (rate + 5) / 10, pos;
+	unsigned ch;
+
+	st = ebur128_init(channels, rate, EBUR128_MODE_I | EBUR128_MODE_LRA);
+	if (st == NULL) {
+		fprintf(stderr, "Could not initialize EBU R128 scanner\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (ch = 0; ch < channels; ch++)
+		ebur128_set_channel(st, ch, meter_default_channel(channels, ch));
+
+	r -> momentary = -HUGE_VAL;
+	r -> shortterm = -HUGE_VAL;
+
+	for (pos = 0; pos + hop <= nb; pos += hop) {
+		double loudness;
+
+		ebur128_add_frames_double(st, x + pos * channels, hop);
+
+		if (pos + hop >= 4 * hop) {
+			ebur128_loudness_momentary(st, &loudness);
+			r -> momentary = fmax(r -> momentary, loudness);
+		}
+
+		if (pos + hop >= 30 * hop && (pos + hop) % (10 * hop) == 0) {
+			ebur128_loudness_shortterm(st, &loudness);
+			r -> shortterm = fmax(r -> shortterm, loudness);
+		}
+	}
+
+	ebur128_loudness_global(st, &r -> integrated);
+	ebur128_loudness_range(st, &r -> range);
+
+	ebur128_destroy(&st);
+}
+
+/* A meter of the engine, tapped into a summary like a scan does it. */
+static void test_meter(const double *x, unsigned channels,
+                       unsigned long rate, size_t nb, const char *engine,
+                       test_result *r) {
+	summary sum, *sums = &sum;
+	tap_pcm pcm;
+	meter *m;
+	tap t;
+
+	m = meter_new(channels, rate, engine, METER_SHORTTERM);
+
+	summary_init(&sum, channels, 0);
+	tap_init(&t, m, &sum, 0, 0, nb);
+
+	pcm.type   = TAP_DBL;
+	pcm.data   = (const uint8_t *) x;
+	pcm.stride = channels * sizeof(double);
+
+	tap_add(&t, &pcm, 0, nb);
+
+	summary_loudness_global(&sums, 1, &r -> integrated);
+	summary_loudness_range(&sums, 1, &r -> range);
+	r -> momentary = summary_loudness(sum.gating.max);
+	r -> shortterm = summary_loudness(sum.shortterm.max);
+
+	summary_free(&sum);
+	meter_free(m);
+}
+
+static int test_check(const char *what, double got, double want) {
+	if (fabs(got - want) <= TEST_LU)
+		return 0;
+
+	printf("  %s: %.4f, libebur128 %.4f\n", what, got, want);
+	return 1;
+}
+
+int main(void) {
+	size_t c, r, e;
+	int failed = 0;
+
+	for (c = 0; c < NB(test_channels); c++) {
+		for (r = 0; r < NB(test_rates); r++) {
+			unsigned channels = test_channels[c];
+			unsigned long rate = test_rates[r];
+			size_t nb = TEST_SECONDS * rate;
+			double *x = test_signal(channels, rate, nb);
+			test_result want;
+
+			test_reference(x, channels, rate, nb, &want);
+
+			for (e = 0; e < NB(test_engines); e++) {
+				const char *engine = test_engines[e];
+				test_result got;
+				int bad = 0;
+
+				if (!meter_engine_valid(engine)) {
+					printf("%u ch %lu Hz %s: not supported, skipped\n",
+					       channels, rate, engine);
+					continue;
+				}
+
+				test_meter(x, channels, rate, nb, engine, &got);
+
+				printf("%u ch %lu Hz %s: I %.2f LUFS, LRA %.2f LU, "
+				       "M %.2f LUFS, S %.2f LUFS\n", channels, rate, engine,
+				       got.integrated, got.range, got.momentary,
+				       got.shortterm);
+
+				bad |= test_check("integrated", got.integrated,
+				                  want.integrated);
+				bad |= test_check("range", got.range, want.range);
+				bad |= test_check("momentary max", got.momentary,
+				                  want.momentary);
+				bad |= test_check("short-term max", got.shortterm,
+				                  want.shortterm);
+
+				failed |= bad;
+			}
+
+			free(x);
+		}
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,186 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Measures what -T costs: a segment's filters start from silence 5 s
+ * before its first block (SCAN_SEGMENT_PREROLL in scan.c) instead of
+ * carrying the state of the previous segment, which is only approximately
+ * the same. Synthetic tracks are tapped as a whole and in segments the
+ * way scan_segmented() splits them, and the results are compared. The
+ * largest differences are printed (the man page quotes them).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <math.h>
+
+#include "summary.h"
+#include "tap.h"
+#include "meter.h"
+
+#define TEST_SECONDS  300
+#define TEST_SEGMENTS 4
+#define TEST_CHANNELS 2
+
+// as scan.c: 100 ms steps of decoder and filter warm-up
+#define TEST_PREROLL  50
+
+#define TEST_LU 1e-6
+
+static const unsigned long test_rates[] = { 44100, 48000, 96000 };
+
+#define NB(a) (sizeof(a) / sizeof(a[0]))
+
+static uint32_t test_seed = 1;
+
+static double test_random(void) {
+	test_seed = test_seed * 1664525 + 1013904223;
+	return test_seed / 4294967296.0;
+}
+
+/*
+ * Noise and a low tone (which the high-pass filter remembers longest),
+ * at a level that wanders between -50 and -8 dBFS from one second to the
+ * next.
+ */
+static double *test_signal(unsigned long rate, size_t nb) {
+	double level = -20.0, gain = 0.0;
+	size_t i;
+	unsigned ch;
+	double *x;
+
+	x = malloc(nb * TEST_CHANNELS * sizeof(double));
+	if (x == NULL) {
+		fprintf(stderr, "OOM\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < nb; i++) {
+		if (i % rate == 0) {
+			level = fmin(-8.0, fmax(-50.0, level + 8.0 * (test_random() - 0.5)));
+			gain  = pow(10.0, level / 20.0);
+		}
+
+		for (ch = 0; ch < TEST_CHANNELS; ch++) {
+			x[i * TEST_CHANNELS + ch] = gain *
+				(0.5 * sin(2.0 * M_PI * 40.0 * i / rate + ch) +
+				 0.5 * (2.0 * test_random() - 1.0));
+		}
+	}
+
+	return x;
+}
+
+/* Taps [origin, end) of the track, recording [from, to). */
+static void test_tap(const double *x, unsigned long rate, summary *sum,
+                     int64_t origin, int64_t from, int64_t to, int64_t end) {
+	tap_pcm pcm;
+	meter *m;
+	tap t;
+
+	m = meter_new(TEST_CHANNELS, rate, "auto", METER_ALL);
+	tap_init(&t, m, sum, origin, from, to);
+
+	pcm.type   = TAP_DBL;
+	pcm.data   = (const uint8_t *) x;
+	pcm.stride = TEST_CHANNELS * sizeof(double);
+
+	tap_add(&t, &pcm, origin, end - origin);
+
+	meter_free(m);
+}
+
+static void test_result(summary *sum, double *r) {
+	summary_loudness_global(&sum, 1, &r[0]);
+	summary_loudness_range(&sum, 1, &r[1]);
+	r[2] = summary_loudness(sum -> gating.max);
+	r[3] = summary_loudness(sum -> shortterm.max);
+	r[4] = 20.0 * log10(summary_peak(sum));
+}
+
+int main(void) {
+	static const char *what[] = {
+		"integrated loudness", "loudness range", "momentary maximum",
+		"short-term maximum", "peak (dB)"
+	};
+	double max[NB(what)] = { 0.0 };
+	int failed = 0;
+	size_t r, k;
+	unsigned i;
+
+	for (r = 0; r < NB(test_rates); r++) {
+		unsigned long rate = test_rates[r];
+		int64_t hop = (rate + 5) / 10;
+		int64_t nb = (int64_t) TEST_SECONDS * rate;
+		int64_t step = nb / TEST_SEGMENTS / (hop * 10) * (hop * 10);
+		double *x = test_signal(rate, nb);
+		double serial[NB(what)], split[NB(what)];
+		summary whole, merged;
+
+		summary_init(&whole, TEST_CHANNELS, 0);
+		test_tap(x, rate, &whole, 0, 0, INT64_MAX, nb);
+		test_result(&whole, serial);
+
+		summary_init(&merged, TEST_CHANNELS, 0);
+
+		for (i = 0; i < TEST_SEGMENTS; i++) {
+			int64_t start = i * step;
+			int64_t end = (i == TEST_SEGMENTS - 1) ? nb : (i + 1) * step;
+			int64_t origin = start - TEST_PREROLL * hop;
+			summary seg;
+
+			summary_init(&seg, TEST_CHANNELS, 0);
+			test_tap(x, rate, &seg, origin > 0 ? origin : 0, start, end, end);
+			summary_merge(&merged, &seg);
+			summary_free(&seg);
+		}
+
+		test_result(&merged, split);
+
+		for (k = 0; k < NB(what); k++) {
+			printf("%lu Hz, %s: %.4f, in %u segments %+.3g\n", rate, what[k],
+			       serial[k], TEST_SEGMENTS, split[k] - serial[k]);
+			max[k] = fmax(max[k], fabs(split[k] - serial[k]));
+		}
+
+		summary_free(&whole);
+		summary_free(&merged);
+		free(x);
+	}
+
+	for (k = 0; k < NB(what); k++) {
+		printf("-T difference, %s: %.3g at most\n", what[k], max[k]);
+		failed |= max[k] > TEST_LU;
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,187 @@
+/*
+ * Loudness normalizer based on the EBU R128 standard
+ *
+ * Copyright (c) 2014, Alessandro Ghedini
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *
+ *     * Redistributions of source code must retain the above copyright
+ *       notice, this list of conditions and the following disclaimer.
+ *
+ *     * Redistributions in binary form must reproduce the above copyright
+ *       notice, this list of conditions and the following disclaimer in the
+ *       documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+ * IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR
+ * PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR
+ * CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL,
+ * EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ * PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ * LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ * NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Runs signals whose peaks fall between samples through the true-peak
+ * interpolator, with every kernel this CPU has and in every rate class
+ * (4x, 2x, none), and compares the peaks with ebur128_true_peak().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <math.h>
+
+#include <ebur128.h>
+
+#include "summary.h"
+#include "tap.h"
+#include "meter.h"
+#include "truepeak.h"
+
+#define TEST_SECONDS 2
+#define TEST_DB      0.05
+
+#define TEST_CHANNELS 2
+
+static const unsigned long test_rates[] = { 44100, 48000, 96000, 192000 };
+
+/* frequency (of the sample rate) and phase of the tone */
+static const double test_tones[][2] = {
+	{ 0.25,  M_PI / 4 }, { 0.2437, 0.3 }, { 0.1,  1.1 }
+};
+
+static const char *test_kernels[] = {
+	"auto", "scalar", "sse2", "avx2", "avx512"
+};
+
+#define NB(a) (sizeof(a) / sizeof(a[0]))
+
+/* The tone in both channels, a quarter turn apart, at -6 dBFS. */
+static double *test_signal(double f, double phase, size_t nb) {
+	double *x;
+	size_t i;
+	unsigned ch;
+
+	x = malloc(nb * TEST_CHANNELS * sizeof(double));
+	if (x == NULL) {
+		fprintf(stderr, "OOM\n");
+		exit(EXIT_FAILURE);
+	}
+
+	for (i = 0; i < nb; i++) {
+		for (ch = 0; ch < TEST_CHANNELS; ch++) {
+			x[i * TEST_CHANNELS + ch] = 0.5 *
+				sin(2.0 * M_PI * f * i + phase + M_PI / 2 * ch);
+		}
+	}
+
+	return x;
+}
+
+static void test_reference(const double *x, unsigned long rate, size_t nb,
+                           double *peak) {
+	ebur128_state *st;
+	unsigned ch;
+
+	st = ebur128_init(TEST_CHANNELS, rate, EBUR128_MODE_TRUE_PEAK);
+	if (st == NULL) {
+		fprintf(stderr, "Could not initialize EBU R128 scanner\n");
+		exit(EXIT_FAILURE);
+	}
+
+	ebur128_add_frames_double(st, x, nb);
+
+	for (ch = 0; ch < TEST_CHANNELS; ch++)
+		ebur128_true_peak(st, ch, &peak[ch]);
+
+	ebur128_destroy(&st);
+}
+
+/*
+ * Fed in 100 ms steps like a meter feeds it; libebur128's true peak is
+ * never below the sample peak, so neither is this one.
+ */
+static void test_truepeak(const double *x, unsigned long rate, size_t nb,
+                          const char *kernel, double *peak) {
+	double floor[TEST_CHANNELS] = { 0.0 };
+	size_t hop = (rate + 5) / 10, pos, i;
+	truepeak *tp;
+	unsigned ch;
+
+	tp = truepeak_new(TEST_CHANNELS, rate, kernel);
+
+	for (ch = 0; ch < TEST_CHANNELS; ch++)
+		peak[ch] = 0.0;
+
+	for (pos = 0; pos < nb; pos += hop) {
+		size_t n = nb - pos < hop ? nb - pos : hop;
+
+		truepeak_add(tp, x + pos * TEST_CHANNELS, TEST_CHANNELS, n,
+		             floor, peak);
+	}
+
+	for (i = 0; i < nb * TEST_CHANNELS; i++) {
+		ch = i % TEST_CHANNELS;
+		peak[ch] = fmax(peak[ch], fabs(x[i]));
+	}
+
+	truepeak_free(tp);
+}
+
+int main(void) {
+	size_t r, t, k;
+	int failed = 0;
+
+	for (r = 0; r < NB(test_rates); r++) {
+		for (t = 0; t < NB(test_tones); t++) {
+			unsigned long rate = test_rates[r];
+			size_t nb = TEST_SECONDS * rate;
+			double *x = test_signal(test_tones[t][0], test_tones[t][1], nb);
+			double want[TEST_CHANNELS];
+
+			test_reference(x, rate, nb, want);
+
+			for (k = 0; k < NB(test_kernels); k++) {
+				const char *kernel = test_kernels[k];
+				double got[TEST_CHANNELS];
+				unsigned ch;
+
+				if (!meter_engine_valid(kernel)) {
+					printf("%lu Hz %s: not supported, skipped\n", rate, kernel);
+					continue;
+				}
+
+				test_truepeak(x, rate, nb,
+				              strcmp(kernel, "auto") == 0 ? NULL : kernel, got);
+
+				for (ch = 0; ch < TEST_CHANNELS; ch++) {
+					double db = 20.0 * log10(got[ch] / want[ch]);
+
+					printf("%lu Hz, tone %.4f fs, ch %u, %s: %.3f dBTP "
+					       "(%+.4f dB)\n", rate, test_tones[t][0], ch, kernel,
+					       20.0 * log10(got[ch]), db);
+
+					if (!(fabs(db) <= TEST_DB)) {
+						printf("  libebur128: %.3f dBTP\n",
+						       20.0 * log10(want[ch]));
+						failed = 1;
+					}
+				}
+			}
+
+			free(x);
+		}
+	}
+
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}